@@ -0,0 +1,128 @@
+#include <muduo_study/tcpServer.h>
+#include <muduo_study/eventLoop.h>
+#include <muduo_study/tcpConnection.h>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+
+// accept/close的吞吐：客户端线程不停地建立连接，服务端连接建立后立即shutdown，客户端读到EOF后close，
+// 统计服务端每秒完成的连接数。用法：accept_churn_bench [连接总数] [ioloop数] [0:全局连接表 1:loop-local] > /dev/null
+// 库的日志写到标准输出，结果写到标准错误
+
+static const uint16_t kPort = 6002;
+
+class ChurnServer
+{
+public:
+
+    ChurnServer(muduo_study::EventLoop *loop, muduo_study::InetAddress &listenAddr, int threads, bool loopLocal)
+    :server_(loop, listenAddr, "ChurnServer"), closed_(0)
+    {
+    server_.setConnectionCallback(std::bind(&ChurnServer::onConnection, this, std::placeholders::_1));
+    server_.setThreadNum(threads);
+    server_.setLoopLocalConnections(loopLocal);
+    }
+
+    void start()
+    {
+    server_.start();
+    }
+
+    int closed() const { return closed_; }
+private:
+    // 连接建立后立即半关闭，对端close后连接被销毁
+    void onConnection(const muduo_study::TcpConnectionPtr &con);
+private:
+    muduo_study::TcpServer server_;
+    std::atomic_int closed_;
+};
+
+void ChurnServer::onConnection(const muduo_study::TcpConnectionPtr &con)
+{
+    if(con->connected())
+    {
+        con->shutdown();
+    }
+    else
+    {
+        ++closed_;
+    }
+}
+
+static void churn(int count)
+{
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    char buf[16];
+    for(int i = 0; i < count; ++i)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if(::connect(fd, (sockaddr*)&addr, sizeof addr) < 0)
+        {
+            std::cout << "connect error " << strerror(errno) << std::endl;
+            ::close(fd);
+            return ;
+        }
+        while(::read(fd, buf, sizeof buf) > 0)
+        {
+        }
+        ::close(fd);
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    const int total = argc > 1 ? atoi(argv[1]) : 20000;
+    const int threads = argc > 2 ? atoi(argv[2]) : 4;
+    const bool loopLocal = argc > 3 && atoi(argv[3]) != 0;
+    const int clients = 4;
+
+    muduo_study::EventLoop event_loop;
+    muduo_study::InetAddress intaddr(kPort, "127.0.0.1");
+    ChurnServer server(&event_loop, intaddr, threads, loopLocal);
+    server.start();
+
+    std::thread bench([&]{
+        usleep(100000);
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for(int i = 0; i < clients; ++i)
+        {
+            workers.emplace_back(churn, total / clients);
+        }
+        for(std::thread& t: workers)
+        {
+            t.join();
+        }
+        const int expected = total / clients * clients;
+        while(server.closed() < expected)
+        {
+            usleep(1000);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        std::cerr << (loopLocal ? "loop-local" : "global") << " threads " << threads
+                  << " connections " << expected << " in " << seconds << " s, "
+                  << static_cast<long>(expected / seconds) << " conn/s" << std::endl;
+        event_loop.quit();
+    });
+
+    event_loop.loop();
+    bench.join();
+}
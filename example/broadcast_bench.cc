@@ -0,0 +1,188 @@
+#include <muduo_study/tcpServer.h>
+#include <muduo_study/eventLoop.h>
+#include <muduo_study/tcpConnection.h>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// 广播扇出：建立大量连接后，向所有连接发送同一份payload，统计从发起到所有客户端收齐的耗时。
+// 对照组在用户线程中逐个调用TcpConnection::send，每个连接投递一次任务。
+// 用法：broadcast_bench [连接数] [ioloop数] [payload字节数] [轮数] > /dev/null
+// 客户端与服务端在同一进程中，每个连接占两个fd：10万连接需要ulimit -n 大于20万；
+// 客户端每2万个连接换一个127.0.0.x源地址，避免临时端口耗尽。库的日志写到标准输出，结果写到标准错误
+
+static const uint16_t kPort = 6003;
+static const int kConnectionsPerSourceIp = 20000;
+
+class BroadcastServer
+{
+public:
+
+    BroadcastServer(muduo_study::EventLoop *loop, muduo_study::InetAddress &listenAddr, int threads)
+    :server_(loop, listenAddr, "BroadcastServer"), connected_(0)
+    {
+    server_.setConnectionCallback(std::bind(&BroadcastServer::onConnection, this, std::placeholders::_1));
+    server_.setThreadNum(threads);
+    }
+
+    void start()
+    {
+    server_.start();
+    }
+
+    int connected() const { return connected_; }
+
+    void broadcast(const muduo_study::PayloadPtr& message)
+    {
+    server_.broadcast(message);
+    }
+
+    // 对照：用户自己保存连接，逐个send
+    void sendEach(const muduo_study::PayloadPtr& message)
+    {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for(const muduo_study::TcpConnectionPtr& con: connections_)
+    {
+        con->send(message);
+    }
+    }
+private:
+    // 记录连接，供对照组使用
+    void onConnection(const muduo_study::TcpConnectionPtr &con);
+private:
+    muduo_study::TcpServer server_;
+    std::atomic_int connected_;
+    std::mutex mutex_;
+    std::vector<muduo_study::TcpConnectionPtr> connections_;
+};
+
+void BroadcastServer::onConnection(const muduo_study::TcpConnectionPtr &con)
+{
+    if(con->connected())
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections_.push_back(con);
+        ++connected_;
+    }
+}
+
+// 客户端：所有socket注册在一个epoll上，读到expected字节后返回
+static void drain(int epfd, size_t expected)
+{
+    std::vector<epoll_event> events(1024);
+    char buf[65536];
+    size_t received = 0;
+    while(received < expected)
+    {
+        int n = ::epoll_wait(epfd, events.data(), static_cast<int>(events.size()), 1000);
+        for(int i = 0; i < n; ++i)
+        {
+            ssize_t k;
+            while((k = ::recv(events[i].data.fd, buf, sizeof buf, MSG_DONTWAIT)) > 0)
+            {
+                received += k;
+            }
+        }
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    const int total = argc > 1 ? atoi(argv[1]) : 10000;
+    const int threads = argc > 2 ? atoi(argv[2]) : 4;
+    const size_t payloadSize = argc > 3 ? static_cast<size_t>(atol(argv[3])) : 64;
+    const int rounds = argc > 4 ? atoi(argv[4]) : 10;
+
+    muduo_study::EventLoop event_loop;
+    muduo_study::InetAddress intaddr(kPort, "127.0.0.1");
+    BroadcastServer server(&event_loop, intaddr, threads);
+    server.start();
+
+    std::thread bench([&]{
+        usleep(100000);
+        int epfd = ::epoll_create1(EPOLL_CLOEXEC);
+        std::vector<int> fds;
+        sockaddr_in serverAddr;
+        memset(&serverAddr, 0, sizeof serverAddr);
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_port = htons(kPort);
+        serverAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        for(int i = 0; i < total; ++i)
+        {
+            int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in local;
+            memset(&local, 0, sizeof local);
+            local.sin_family = AF_INET;
+            local.sin_addr.s_addr = htonl(0x7f000002 + i / kConnectionsPerSourceIp);
+            if(fd < 0 || ::bind(fd, (sockaddr*)&local, sizeof local) < 0
+               || ::connect(fd, (sockaddr*)&serverAddr, sizeof serverAddr) < 0)
+            {
+                std::cerr << "connection " << i << " failed: " << strerror(errno) << std::endl;
+                ::exit(1);
+            }
+            epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.fd = fd;
+            ::epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+            fds.push_back(fd);
+        }
+        while(server.connected() < total)
+        {
+            usleep(1000);
+        }
+
+        const muduo_study::PayloadPtr payload = std::make_shared<std::string>(payloadSize, 'b');
+        const size_t expected = payloadSize * total;
+        for(int mode = 0; mode < 2; ++mode)
+        {
+            double sum = 0;
+            double max = 0;
+            for(int r = 0; r < rounds; ++r)
+            {
+                auto begin = std::chrono::steady_clock::now();
+                if(mode == 0)
+                {
+                    server.broadcast(payload);
+                }
+                else
+                {
+                    server.sendEach(payload);
+                }
+                drain(epfd, expected);
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+                sum += ms;
+                max = std::max(max, ms);
+            }
+            std::cerr << (mode == 0 ? "broadcast" : "send each") << ": " << total << " connections, "
+                      << threads << " io loops, " << payloadSize << " bytes, avg " << sum / rounds
+                      << " ms, max " << max << " ms" << std::endl;
+        }
+
+        for(int fd: fds)
+        {
+            ::close(fd);
+        }
+        ::close(epfd);
+        event_loop.quit();
+    });
+
+    event_loop.loop();
+    bench.join();
+}
@@ -0,0 +1,108 @@
+#include <muduo_study/buffer.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+
+// Buff的整数编解码：定长网络字节序与varint的编码/解码耗时和编码后的字节数，
+// 以及按旧方式retrieveAsString后手工转换字节序的解码耗时作为对照。
+// 用法：buffer_codec_bench [整数个数]
+
+static double nsPerValue(std::chrono::steady_clock::time_point begin, size_t count)
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / count;
+}
+
+static void bench(const char* name, const std::vector<uint64_t>& values)
+{
+    const size_t count = values.size();
+    uint64_t sum = 0;
+
+    muduo_study::Buff fixed(count * sizeof(int64_t));
+    auto begin = std::chrono::steady_clock::now();
+    for(uint64_t v: values)
+    {
+        fixed.appendInt64(static_cast<int64_t>(v));
+    }
+    const double fixedEncode = nsPerValue(begin, count);
+    const size_t fixedBytes = fixed.readableBytes();
+    muduo_study::Buff copied(fixed);
+
+    begin = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < count; ++i)
+    {
+        sum += static_cast<uint64_t>(fixed.readInt64());
+    }
+    const double fixedDecode = nsPerValue(begin, count);
+
+    // 对照：取出字符串再拷贝、转换字节序
+    begin = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < count; ++i)
+    {
+        std::string s = copied.retrieveAsString(sizeof(uint64_t));
+        uint64_t be64 = 0;
+        ::memcpy(&be64, s.data(), sizeof(be64));
+        sum += be64toh(be64);
+    }
+    const double stringDecode = nsPerValue(begin, count);
+
+    muduo_study::Buff varint(count * muduo_study::Buff::kMaxVarint64Bytes);
+    begin = std::chrono::steady_clock::now();
+    for(uint64_t v: values)
+    {
+        varint.appendVarint64(v);
+    }
+    const double varintEncode = nsPerValue(begin, count);
+    const size_t varintBytes = varint.readableBytes();
+
+    begin = std::chrono::steady_clock::now();
+    uint64_t value = 0;
+    while(varint.readVarint64(&value) == muduo_study::Buff::kVarintOk)
+    {
+        sum += value;
+    }
+    const double varintDecode = nsPerValue(begin, count);
+
+    std::cout << name << " (" << count << " values, checksum " << sum % 1000 << ")" << std::endl;
+    std::cout << "  int64  encode " << fixedEncode << " ns  decode " << fixedDecode << " ns  "
+              << fixedBytes << " bytes" << std::endl;
+    std::cout << "  string decode " << stringDecode << " ns" << std::endl;
+    std::cout << "  varint encode " << varintEncode << " ns  decode " << varintDecode << " ns  "
+              << varintBytes << " bytes" << std::endl;
+}
+
+
+int main(int argc, char* argv[])
+{
+    const size_t count = argc > 1 ? static_cast<size_t>(atol(argv[1])) : 1000000;
+    std::mt19937_64 rng(12345);
+    std::vector<uint64_t> values(count);
+
+    // 长度、计数等小整数，varint只需1字节
+    for(uint64_t& v: values)
+    {
+        v = rng() % 128;
+    }
+    bench("small", values);
+
+    // 32位范围内均匀分布
+    for(uint64_t& v: values)
+    {
+        v = rng() & 0xffffffff;
+    }
+    bench("uint32", values);
+
+    // 64位均匀分布，varint需要10字节
+    for(uint64_t& v: values)
+    {
+        v = rng();
+    }
+    bench("uint64", values);
+}
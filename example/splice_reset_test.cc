@@ -0,0 +1,242 @@
+#include <muduo_study/tcpServer.h>
+#include <muduo_study/eventLoop.h>
+#include <muduo_study/tcpConnection.h>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// splice转发的连接在各种关闭顺序下都应被关闭，而不是留下没有事件的连接：
+// 1. 目的端在数据源灌满管道时被RST：数据源连接应被关闭，其对端的写入应当出错返回，而不是一直阻塞
+// 2. 单向转发，数据源正常EOF后目的端的对端关闭：两个连接都被关闭，数据源的对端读到EOF
+// 3. 双向转发，两端先后EOF再关闭：两个连接都被关闭
+
+static const uint16_t kPort = 6001;
+static const size_t kPayloadBytes = 1024 * 1024;
+
+static int connectServer()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if(::connect(fd, (sockaddr*)&addr, sizeof addr) < 0)
+    {
+        std::cout << "connect error " << errno << std::endl;
+    }
+    // 读写阻塞超过5秒视为连接被泄漏
+    timeval tv = {5, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv);
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+    return fd;
+}
+
+// 写完kPayloadBytes后半关闭
+static bool writeAndShutdown(int fd)
+{
+    std::string data(kPayloadBytes, 'x');
+    size_t offset = 0;
+    while(offset < data.size())
+    {
+        ssize_t n = ::send(fd, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+        if(n <= 0)
+        {
+            return false;
+        }
+        offset += n;
+    }
+    return ::shutdown(fd, SHUT_WR) == 0;
+}
+
+// 读到EOF，返回读到的字节数；出错或超时返回-1
+static ssize_t readUntilEof(int fd)
+{
+    char buf[65536];
+    ssize_t total = 0;
+    while(true)
+    {
+        ssize_t n = ::read(fd, buf, sizeof buf);
+        if(n == 0)
+        {
+            return total;
+        }
+        if(n < 0)
+        {
+            return -1;
+        }
+        total += n;
+    }
+}
+
+class SpliceServer
+{
+public:
+
+    SpliceServer(muduo_study::EventLoop *loop, muduo_study::InetAddress &listenAddr)
+    :server_(loop, listenAddr, "SpliceServer"), closed_(0), bidirectional_(false)
+    {
+    server_.setConnectionCallback(std::bind(&SpliceServer::onConnection, this, std::placeholders::_1));
+    }
+
+    void start()
+    {
+    server_.start();
+    }
+
+    int closed() const { return closed_; }
+    void setBidirectional(bool on) { bidirectional_ = on; }
+
+    // 等待关闭的连接数达到expected，最多2秒
+    bool waitClosed(int expected) const
+    {
+    for(int i = 0; i < 200 && closed_ < expected; ++i)
+    {
+        usleep(10000);
+    }
+    return closed_ == expected;
+    }
+private:
+    // 依次到来的两个连接为一组，前一个是数据源，后一个是目的端
+    void onConnection(const muduo_study::TcpConnectionPtr &con);
+private:
+    muduo_study::TcpServer server_;
+    muduo_study::TcpConnectionPtr pending_;
+    std::atomic_int closed_;
+    std::atomic_bool bidirectional_;
+};
+
+void SpliceServer::onConnection(const muduo_study::TcpConnectionPtr &con)
+{
+    if(con->connected())
+    {
+        if(!pending_)
+        {
+            pending_ = con;
+            return ;
+        }
+        pending_->startSplice(con);
+        if(bidirectional_)
+        {
+            con->startSplice(pending_);
+        }
+        pending_.reset();
+    }
+    else
+    {
+        ++closed_;
+    }
+}
+
+
+int main()
+{
+    muduo_study::EventLoop event_loop;
+    muduo_study::InetAddress intaddr(kPort, "127.0.0.1");
+    SpliceServer server(&event_loop, intaddr);
+    server.start();
+
+    bool ok = true;
+    std::thread client([&]{
+        usleep(100000);
+
+        // 1. 目的端RST
+        {
+            int src = connectServer();
+            usleep(50000);
+            int dst = connectServer();
+            usleep(50000);
+
+            ssize_t lastError = 0;
+            std::thread writer([&]{
+                std::string chunk(64 * 1024, 'x');
+                while(true)
+                {
+                    ssize_t n = ::send(src, chunk.data(), chunk.size(), MSG_NOSIGNAL);
+                    if(n <= 0)
+                    {
+                        lastError = errno;
+                        break;
+                    }
+                }
+            });
+
+            // 目的端不读，等待管道与各级缓冲区灌满后以SO_LINGER 0关闭，发出RST
+            usleep(500000);
+            linger lg = {1, 0};
+            ::setsockopt(dst, SOL_SOCKET, SO_LINGER, &lg, sizeof lg);
+            ::close(dst);
+
+            writer.join();
+            const bool reset = (lastError == EPIPE || lastError == ECONNRESET) && server.waitClosed(2);
+            std::cout << "reset: source write error " << strerror(static_cast<int>(lastError))
+                      << ", closed " << server.closed() << (reset ? " PASS" : " FAIL") << std::endl;
+            ok = ok && reset;
+            ::close(src);
+        }
+
+        // 2. 单向转发：数据源EOF，目的端读完后关闭
+        {
+            int src = connectServer();
+            usleep(50000);
+            int dst = connectServer();
+            usleep(50000);
+
+            std::thread writer([&]{ writeAndShutdown(src); });
+            const ssize_t relayed = readUntilEof(dst);
+            writer.join();
+            ::close(dst);
+            const ssize_t srcEof = readUntilEof(src);
+            const bool eof = relayed == static_cast<ssize_t>(kPayloadBytes) && srcEof == 0 && server.waitClosed(4);
+            std::cout << "eof then close: relayed " << relayed << ", source eof " << (srcEof == 0)
+                      << ", closed " << server.closed() << (eof ? " PASS" : " FAIL") << std::endl;
+            ok = ok && eof;
+            ::close(src);
+        }
+
+        // 3. 双向转发：两端都写完后半关闭，读到EOF后关闭
+        {
+            server.setBidirectional(true);
+            int a = connectServer();
+            usleep(50000);
+            int b = connectServer();
+            usleep(50000);
+
+            std::thread writerA([&]{ writeAndShutdown(a); });
+            std::thread writerB([&]{ writeAndShutdown(b); });
+            ssize_t gotA = 0;
+            std::thread readerA([&]{ gotA = readUntilEof(a); });
+            const ssize_t gotB = readUntilEof(b);
+            readerA.join();
+            writerA.join();
+            writerB.join();
+            ::close(a);
+            ::close(b);
+            const bool both = gotA == static_cast<ssize_t>(kPayloadBytes) && gotB == static_cast<ssize_t>(kPayloadBytes)
+                              && server.waitClosed(6);
+            std::cout << "bidirectional: a got " << gotA << ", b got " << gotB
+                      << ", closed " << server.closed() << (both ? " PASS" : " FAIL") << std::endl;
+            ok = ok && both;
+        }
+
+        event_loop.quit();
+    });
+
+    event_loop.loop();
+    client.join();
+
+    std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
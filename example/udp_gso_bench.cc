@@ -0,0 +1,142 @@
+#include <muduo_study/udpServer.h>
+#include <muduo_study/udpChannel.h>
+#include <muduo_study/eventLoop.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+
+
+// UDP发送/接收的吞吐：同一台机器的回环地址上，发送线程持续发送1000字节的数据报，统计服务端每秒收到的数据报数与系统调用次数。
+// 用法：udp_gso_bench [plain|mmsg|gso] [秒数] > /dev/null
+// plain: 每个数据报一次sendto，服务端不开GRO；mmsg: UdpChannel::send排队后sendmmsg批量发送；gso: sendSegmented + 服务端GRO
+// 库的日志写到标准输出，结果写到标准错误
+
+static const size_t kDatagramSize = 1000;
+static const size_t kDatagramsPerRound = 64;
+
+class BenchServer
+{
+public:
+
+    BenchServer(muduo_study::EventLoop *loop, bool gro)
+    :server_(loop, muduo_study::InetAddress(0, "127.0.0.1"), "UdpBench"), received_(0), bad_(0)
+    {
+    server_.setBatchCallback(std::bind(&BenchServer::onBatch, this, std::placeholders::_1,
+                                       std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
+    server_.setGro(gro);
+    // 开启GRO时每个槽位为64KB，减小每批的数量
+    server_.setBatchSize(gro ? 8 : 64);
+    server_.setRecvBuffer(8 << 20);
+    }
+
+    void start()
+    {
+    server_.start();
+    }
+
+    const muduo_study::InetAddress& address() const { return server_.localAddress(); }
+    uint64_t received() const { return received_; }
+    uint64_t bad() const { return bad_; }
+    uint64_t recvSyscalls() const { return server_.channels()[0]->recvSyscalls(); }
+private:
+    // 只计数并检查长度，不回复
+    void onBatch(const muduo_study::UdpChannelPtr &channel, const muduo_study::UdpMessage *messages, size_t count,
+                 muduo_study::Timestamp time);
+private:
+    muduo_study::UdpServer server_;
+    std::atomic<uint64_t> received_;
+    std::atomic<uint64_t> bad_;
+};
+
+void BenchServer::onBatch(const muduo_study::UdpChannelPtr &channel, const muduo_study::UdpMessage *messages, size_t count,
+                          muduo_study::Timestamp time)
+{
+    for(size_t i = 0; i < count; ++i)
+    {
+        if(messages[i].len != kDatagramSize)
+        {
+            ++bad_;
+        }
+    }
+    received_ += count;
+}
+
+
+int main(int argc, char* argv[])
+{
+    const std::string mode = argc > 1 ? argv[1] : "gso";
+    const double seconds = argc > 2 ? atof(argv[2]) : 1.0;
+    if(mode != "plain" && mode != "mmsg" && mode != "gso")
+    {
+        std::cerr << "usage: udp_gso_bench [plain|mmsg|gso] [seconds]" << std::endl;
+        return 1;
+    }
+
+    muduo_study::EventLoop event_loop;
+    BenchServer server(&event_loop, mode == "gso");
+    server.start();
+    const muduo_study::InetAddress to = server.address();
+
+    uint64_t sendSyscalls = 0;
+    std::thread sender([&]{
+        muduo_study::EventLoop client_loop;
+        muduo_study::UdpChannelPtr channel = std::make_shared<muduo_study::UdpChannel>(
+            &client_loop, muduo_study::InetAddress(0, "127.0.0.1"), false);
+        const std::string round(kDatagramSize * kDatagramsPerRound, 'x');
+
+        auto begin = std::chrono::steady_clock::now();
+        uint64_t rounds = 0;
+        while(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() < seconds)
+        {
+            if(mode == "plain")
+            {
+                for(size_t i = 0; i < kDatagramsPerRound; ++i)
+                {
+                    ::sendto(channel->fd(), round.data(), kDatagramSize, 0, to.getSockAddr(), to.length());
+                }
+                sendSyscalls += kDatagramsPerRound;
+            }
+            else if(mode == "mmsg")
+            {
+                for(size_t i = 0; i < kDatagramsPerRound; ++i)
+                {
+                    channel->send(to, round.data() + i * kDatagramSize, kDatagramSize);
+                }
+                // client_loop不运行：第一次send安排的flush任务一直挂起，之后的send不再安排，由这里显式发出
+                channel->flush();
+            }
+            else
+            {
+                channel->sendSegmented(to, round.data(), round.size(), kDatagramSize);
+            }
+            // 回环上发送方远快于接收方，稍作停顿，避免接收缓冲区溢出使结果只反映丢包
+            if(++rounds % 100 == 0)
+            {
+                usleep(100);
+            }
+        }
+        if(mode != "plain")
+        {
+            sendSyscalls = channel->sendSyscalls();
+        }
+        usleep(200000);
+        event_loop.quit();
+    });
+
+    event_loop.loop();
+    sender.join();
+
+    std::cerr << mode << ": received " << server.received() << " datagrams in " << seconds << " s, "
+              << static_cast<long>(server.received() / seconds) << " datagrams/s, "
+              << "send syscalls " << sendSyscalls << ", recv syscalls " << server.recvSyscalls()
+              << ", bad " << server.bad() << std::endl;
+}
@@ -1,9 +1,13 @@
 #include "acceptor.h"
 #include "inetAddress.h"
 #include "logger.h"
+#include "eventLoop.h"
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 
 
 namespace muduo_study
@@ -11,42 +15,200 @@ namespace muduo_study
 
 Acceptor::Acceptor(EventLoop* loop, const InetAddress& listentAddr, bool reuseport)
     :loop_(loop),
-    acceptSocket_(::socket(listentAddr.family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP)),
+    acceptSocket_(::socket(listentAddr.family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, listentAddr.isUnix()? 0: IPPROTO_TCP)),
     accpetChannel_(loop, acceptSocket_.fd()),
     listening_(false),
-    idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC))
+    idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC)),
+    listenAddr_(listentAddr),
+    maxConnections_(0),
+    overloadAction_(kStopReading),
+    acceptPaused_(false),
+    resumeTimer_(0),
+    activeConnections_(0),
+    accepted_(0),
+    rejectedByLimit_(0),
+    rejectedByRate_(0),
+    pausedByLimit_(0),
+    pausedByRate_(0)
 {
-    acceptSocket_.setReusePort(reuseport);
-    acceptSocket_.setReuseAddr(true);
-    acceptSocket_.bindAddress(listentAddr);
+    if(listentAddr.isUnix())
+    {
+        /// 路径形式的地址：删除上次进程退出时遗留的socket文件，否则bind返回EADDRINUSE
+        if(!listentAddr.isAbstractUnix())
+        {
+            unixPath_ = listentAddr.toIp();
+            struct stat st;
+            if(::stat(unixPath_.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+            {
+                /// 先尝试连接：连接被拒绝说明没有进程在监听，文件是遗留的；连接成功说明另一个实例正在使用该路径，不能删除
+                int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                const int ret = ::connect(probe, listentAddr.getSockAddr(), listentAddr.length());
+                const int savedErrno = errno;
+                ::close(probe);
+                if(ret == 0)
+                {
+                    LOG_FATAL("acceptor unix path %s is in use by another listener", unixPath_.c_str());
+                }
+                else if(savedErrno == ECONNREFUSED)
+                {
+                    ::unlink(unixPath_.c_str());
+                }
+            }
+        }
+    }
+    else
+    {
+        acceptSocket_.setReusePort(reuseport);
+        acceptSocket_.setReuseAddr(true);
+    }
     accpetChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
 }
 
 Acceptor::~Acceptor()
 {
+    if(resumeTimer_ != 0)
+    {
+        loop_->cancel(resumeTimer_);
+    }
     accpetChannel_.disableAll();
     accpetChannel_.remove();
     ::close(idleFd_);
+    if(!unixPath_.empty())
+    {
+        ::unlink(unixPath_.c_str());
+    }
 }
 
 
 void Acceptor::listen()
 {
     listening_ = true;
-    acceptSocket_.listen();
+    options_.applyToListener(acceptSocket_, listenAddr_.family());
+    acceptSocket_.bindAddress(listenAddr_);
+    acceptSocket_.listen(options_.backlog);
+    accpetChannel_.enableReading();
+}
+
+
+void Acceptor::stop()
+{
+    if(!listening_)
+    {
+        return ;
+    }
+    listening_ = false;
+    accpetChannel_.disableAll();
+    if(::shutdown(acceptSocket_.fd(), SHUT_RD) < 0)
+    {
+        LOG_ERROR("acceptor::stop shutdown listenfd %d error %d", acceptSocket_.fd(), errno);
+    }
+}
+
+
+void Acceptor::setAdmissionControl(size_t maxConnections, double acceptRate, double burst, OverloadAction action)
+{
+    maxConnections_ = maxConnections;
+    acceptBucket_.reset(acceptRate, burst);
+    overloadAction_ = action;
+}
+
+void Acceptor::connectionClosed()
+{
+    const size_t active = --activeConnections_;
+    const size_t maxConnections = maxConnections_;
+    if(acceptPaused_ && maxConnections > 0 && active < maxConnections)
+    {
+        loop_->runInloop(std::bind(&Acceptor::resumeAccept, this));
+    }
+}
+
+Acceptor::AdmissionStats Acceptor::admissionStats() const
+{
+    AdmissionStats stats;
+    stats.active = activeConnections_;
+    stats.accepted = accepted_;
+    stats.rejectedByLimit = rejectedByLimit_;
+    stats.rejectedByRate = rejectedByRate_;
+    stats.pausedByLimit = pausedByLimit_;
+    stats.pausedByRate = pausedByRate_;
+    return stats;
+}
+
+void Acceptor::pauseAccept(double delay)
+{
+    acceptPaused_ = true;
+    accpetChannel_.disableReading();
+    if(delay > 0 && resumeTimer_ == 0)
+    {
+        resumeTimer_ = loop_->runAfter(delay, [this]
+        {
+            resumeTimer_ = 0;
+            resumeAccept();
+        });
+    }
+}
+
+void Acceptor::resumeAccept()
+{
+    if(!acceptPaused_ || !listening_)
+    {
+        return ;
+    }
+    if(maxConnections_ > 0 && activeConnections_ >= maxConnections_)
+    {
+        return ;
+    }
+    acceptPaused_ = false;
     accpetChannel_.enableReading();
 }
 
+void Acceptor::resetConnection(int connfd)
+{
+    struct linger lg;
+    lg.l_onoff = 1;
+    lg.l_linger = 0;
+    ::setsockopt(connfd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    ::close(connfd);
+}
 
 void Acceptor::handleRead()
 {
-    sockaddr_in sockaddr_in_;
-    InetAddress peerAddr(sockaddr_in_);
+    /// 先判断是否超限，kStopReading时不accept，连接留在backlog中
+    const bool overLimit = maxConnections_ > 0 && activeConnections_ >= maxConnections_;
+    const bool overRate = !overLimit && !acceptBucket_.tryConsume(1);
+    if((overLimit || overRate) && overloadAction_ == kStopReading)
+    {
+        if(overLimit)
+        {
+            ++pausedByLimit_;
+            pauseAccept(0);
+            /// 设置acceptPaused_之前关闭的连接看不到暂停标志，不会投递恢复任务，这里再检查一次
+            if(activeConnections_ < maxConnections_)
+            {
+                resumeAccept();
+            }
+        }
+        else
+        {
+            ++pausedByRate_;
+            pauseAccept(acceptBucket_.waitTime(1));
+        }
+        return ;
+    }
+
+    InetAddress peerAddr;
     int connfd = acceptSocket_.accept(&peerAddr);
-    if(connfd >=0 )
+    if(connfd >= 0 && (overLimit || overRate))
+    {
+        ++(overLimit? rejectedByLimit_: rejectedByRate_);
+        resetConnection(connfd);
+    }
+    else if(connfd >=0 )
     {
+        ++accepted_;
         if(newConnectionCallback_)
         {
+            ++activeConnections_;
             newConnectionCallback_(connfd, peerAddr);
         }
         else
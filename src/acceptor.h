@@ -3,15 +3,20 @@
 #include "nocopyable.h"
 #include "socket.h"
 #include "channel.h"
+#include "callback.h"
+#include "tokenBucket.h"
+#include "socketOptions.h"
+#include "inetAddress.h"
 
 #include <functional>
+#include <atomic>
+#include <string>
 
 
 namespace muduo_study
 {
 
 class EventLoop;
-class InetAddress;
 
 /**
  * @brief listenfd封装类
@@ -22,6 +27,33 @@ class Acceptor: nocopyable
 public:
     using NewConnectionCallback = std::function<void(int sockfd, const InetAddress& )>;
 
+    /**
+     * @brief 超过连接数上限或accept速率时的处理方式
+     * @details kStopReading: 暂停监听fd的读事件，新连接留在内核backlog中，有连接关闭或令牌补充后恢复
+     * @details kReset: 照常accept，随即以SO_LINGER(0)关闭，对端立即收到RST
+     */
+    enum OverloadAction
+    {
+        kStopReading,
+        kReset
+    };
+
+    /**
+     * @brief 准入控制的计数
+     */
+    struct AdmissionStats
+    {
+        /// 当前连接数，以及累计接受的连接数
+        size_t active;
+        uint64_t accepted;
+        /// 因连接数上限、accept速率被RST的连接数
+        uint64_t rejectedByLimit;
+        uint64_t rejectedByRate;
+        /// 因连接数上限、accept速率暂停读事件的次数
+        uint64_t pausedByLimit;
+        uint64_t pausedByRate;
+    };
+
     /**
      * @param[in] loop 该loop为mainloop，有用户创建，并传到TcpServer, 然后实例化给acceptor
      */ 
@@ -35,11 +67,39 @@ public:
     void setNewConnectionCallback(const NewConnectionCallback& cb){newConnectionCallback_ = cb;}
 
     /**
-     * @brief 开启监听，并将读事件注册到main reactor。
+     * @brief 应用socket选项并bind，开启监听，并将读事件注册到main reactor。
+     * @note bind推迟到listen时进行，使IPV6_V6ONLY、SO_RCVBUF等需要在bind之前设置的选项生效
      */ 
     void listen();
     bool listening() const { return listening_;}
 
+    /**
+     * @brief listen时应用的socket选项，需在listen之前设置
+     */
+    void setSocketOptions(const SocketOptions& options) { options_ = options; }
+
+    /**
+     * @brief 停止接受新连接：从main reactor注销读事件，并让内核不再完成新的握手
+     * @details 对监听socket执行shutdown(SHUT_RD)，Linux下监听socket随即退出LISTEN状态，
+     * @details 已在backlog中未accept的连接被RST，客户端可以立即重试其他实例，而不是等到进程退出
+     */
+    void stop();
+
+    /**
+     * @brief 设置准入控制，只能在loop线程调用
+     * @param[in] maxConnections 同时存在的连接数上限，0表示不限制
+     * @param[in] acceptRate 每秒accept的连接数，0表示不限制；burst为允许的突发数
+     */
+    void setAdmissionControl(size_t maxConnections, double acceptRate, double burst, OverloadAction action);
+
+    /**
+     * @brief 交给newConnectionCallback_的连接关闭后调用，可在任意线程调用
+     * @details 读事件已暂停且连接数降到上限以下时，才向loop投递恢复读事件的任务
+     */
+    void connectionClosed();
+
+    AdmissionStats admissionStats() const;
+
 private:
 
     /**
@@ -47,6 +107,17 @@ private:
      */ 
     void handleRead();   
 
+    /**
+     * @brief 暂停监听fd的读事件，delay大于0时在delay秒后尝试恢复
+     */
+    void pauseAccept(double delay);
+    void resumeAccept();
+
+    /**
+     * @brief 以RST关闭被拒绝的连接，不经过FIN_WAIT/TIME_WAIT
+     */
+    static void resetConnection(int connfd);
+
     /// baseloop也就是mainloop也就是用户定义的loop
     EventLoop* loop_;   
     /// listen的fd，
@@ -58,6 +129,23 @@ private:
     ///是否 sock::listen
     bool listening_;  
     int idleFd_;
+    SocketOptions options_;
+    /// 监听地址；Unix domain socket监听的文件路径，析构时删除，抽象地址为空
+    const InetAddress listenAddr_;
+    std::string unixPath_;
+
+    /// 准入控制；maxConnections_、acceptPaused_和activeConnections_会被各个ioloop在连接关闭时读取/递减，其余只在loop线程访问
+    std::atomic<size_t> maxConnections_;
+    TokenBucket acceptBucket_;
+    OverloadAction overloadAction_;
+    std::atomic_bool acceptPaused_;
+    TimerId resumeTimer_;
+    std::atomic<size_t> activeConnections_;
+    std::atomic<uint64_t> accepted_;
+    std::atomic<uint64_t> rejectedByLimit_;
+    std::atomic<uint64_t> rejectedByRate_;
+    std::atomic<uint64_t> pausedByLimit_;
+    std::atomic<uint64_t> pausedByRate_;
 
 };
 
@@ -1,7 +1,11 @@
 #include "buffer.h"
 
 #include <errno.h>
+#include <unistd.h>
 #include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/memfd.h>
 
 
 
@@ -11,6 +15,146 @@ const char Buff::kCRLF[] = "\r\n";
 
 const size_t Buff::kCheapPrepend;
 const size_t Buff::kInitialSize;
+const size_t Buff::kMaxVarint64Bytes;
+
+namespace
+{
+
+/**
+ * @brief 将同一块memfd内存连续映射两次，返回2*capacity大小区域的首地址，失败返回nullptr
+ */
+char* mapMirrored(size_t capacity)
+{
+    int fd = static_cast<int>(::syscall(SYS_memfd_create, "muduo_study_buff", MFD_CLOEXEC));
+    if(fd < 0)
+    {
+        return nullptr;
+    }
+    if(::ftruncate(fd, static_cast<off_t>(capacity)) < 0)
+    {
+        ::close(fd);
+        return nullptr;
+    }
+
+    /// 先保留2*capacity的连续地址，再用MAP_FIXED把前后两半都映射到memfd
+    void* addr = ::mmap(NULL, 2*capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(addr == MAP_FAILED)
+    {
+        ::close(fd);
+        return nullptr;
+    }
+    char* base = static_cast<char*>(addr);
+    if(::mmap(base, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+       || ::mmap(base + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        ::munmap(base, 2*capacity);
+        ::close(fd);
+        return nullptr;
+    }
+    ::close(fd);
+    return base;
+}
+
+size_t roundUpToPage(size_t len)
+{
+    const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    return (len + page - 1) / page * page;
+}
+
+} // namespace
+
+Buff::Buff(const Buff& rhs)
+    : buf_(),
+    readerIndex_(rhs.readerIndex_),
+    writerIndex_(rhs.writerIndex_),
+    ring_(nullptr),
+    ringCapacity_(0)
+{
+    if(rhs.ring_)
+    {
+        buf_.resize(kCheapPrepend + rhs.readableBytes());
+        std::copy(rhs.peek(), rhs.peek() + rhs.readableBytes(), buf_.begin() + kCheapPrepend);
+        readerIndex_ = kCheapPrepend;
+        writerIndex_ = kCheapPrepend + rhs.readableBytes();
+    }
+    else
+    {
+        buf_ = rhs.buf_;
+    }
+}
+
+Buff::Buff(Buff&& rhs)
+    : buf_(std::move(rhs.buf_)),
+    readerIndex_(rhs.readerIndex_),
+    writerIndex_(rhs.writerIndex_),
+    ring_(rhs.ring_),
+    ringCapacity_(rhs.ringCapacity_)
+{
+    rhs.ring_ = nullptr;
+    rhs.ringCapacity_ = 0;
+    rhs.buf_.resize(kCheapPrepend);
+    rhs.readerIndex_ = kCheapPrepend;
+    rhs.writerIndex_ = kCheapPrepend;
+}
+
+Buff::~Buff()
+{
+    if(ring_)
+    {
+        ::munmap(ring_, 2*ringCapacity_);
+    }
+}
+
+bool Buff::useMirroredStorage(size_t capacity)
+{
+    if(ring_)
+    {
+        return true;
+    }
+    capacity = roundUpToPage(std::max(capacity, readableBytes()));
+    char* ring = mapMirrored(capacity);
+    if(ring == nullptr)
+    {
+        return false;
+    }
+
+    const size_t readable = readableBytes();
+    std::copy(peek(), peek() + readable, ring);
+    std::vector<char>().swap(buf_);
+    ring_ = ring;
+    ringCapacity_ = capacity;
+    readerIndex_ = 0;
+    writerIndex_ = readable;
+    return true;
+}
+
+void Buff::growRing(size_t capacity)
+{
+    capacity = roundUpToPage(std::max(capacity, 2*ringCapacity_));
+    char* ring = mapMirrored(capacity);
+    if(ring == nullptr)
+    {
+        /// 无法重新映射时退回vector存储，保证写入成功
+        const size_t readable = readableBytes();
+        std::vector<char> buf(kCheapPrepend + capacity);
+        std::copy(peek(), peek() + readable, buf.begin() + kCheapPrepend);
+        ::munmap(ring_, 2*ringCapacity_);
+        ring_ = nullptr;
+        ringCapacity_ = 0;
+        buf_.swap(buf);
+        readerIndex_ = kCheapPrepend;
+        writerIndex_ = kCheapPrepend + readable;
+        return ;
+    }
+
+    const size_t readable = readableBytes();
+    std::copy(peek(), peek() + readable, ring);
+    ::munmap(ring_, 2*ringCapacity_);
+    ring_ = ring;
+    ringCapacity_ = capacity;
+    readerIndex_ = 0;
+    writerIndex_ = readable;
+}
 
 
 ssize_t Buff::readFd(int fd, int* saveErrno)
@@ -37,7 +181,7 @@ ssize_t Buff::readFd(int fd, int* saveErrno)
     }
     else
     {
-        writerIndex_  = buf_.size();
+        writerIndex_ += writable;
         append(extrabuf, n-writable);
     }
 
@@ -4,6 +4,9 @@
 #include <algorithm>
 #include <string.h>
 #include <string>
+#include <stdint.h>
+#include <endian.h>
+#include <assert.h>
 
 
 namespace muduo_study
@@ -19,13 +22,44 @@ public:
     static const size_t kCheapPrepend = 8;
     /// 初始缓冲区大小1024
     static const size_t kInitialSize = 1024;
+    /// varint64编码的最大字节数
+    static const size_t kMaxVarint64Bytes = 10;
+
+    /**
+     * @brief varint的解析结果：完整，数据不完整(需要等待更多数据)，格式错误(超过10字节或超出64位，应断开连接)
+     */
+    enum VarintResult
+    {
+        kVarintOk,
+        kVarintIncomplete,
+        kVarintMalformed
+    };
 
     explicit Buff(size_t initialSize = kInitialSize)
     : buf_(kCheapPrepend + initialSize),
     readerIndex_(kCheapPrepend),
-    writerIndex_(kCheapPrepend)
+    writerIndex_(kCheapPrepend),
+    ring_(nullptr),
+    ringCapacity_(0)
+    {
+    }
+
+    /**
+     * @brief 拷贝得到的总是vector存储的Buff，只包含可读数据
+     */
+    Buff(const Buff& rhs);
+
+    /**
+     * @brief 移走存储(vector或镜像环)，rhs恢复为kCheapPrepend大小的空vector存储
+     * @note 恢复rhs需要分配内存，因此不是noexcept
+     */
+    Buff(Buff&& rhs);
+    Buff& operator=(Buff rhs)
     {
+        swap(rhs);
+        return *this;
     }
+    ~Buff();
 
     /**
      * @brief buffer的交换
@@ -35,8 +69,25 @@ public:
         buf_.swap(rhs.buf_);
         std::swap(readerIndex_, rhs.readerIndex_);
         std::swap(writerIndex_, rhs.writerIndex_);
+        std::swap(ring_, rhs.ring_);
+        std::swap(ringCapacity_, rhs.ringCapacity_);
     }
 
+    /**
+     * @brief 切换为镜像环形存储，已有的可读数据被保留
+     * @details 用memfd创建capacity(按页对齐)大小的内存，并把它连续映射两次，环形缓冲区的可读、可写区域因此总是连续的，
+     * @details readFd、peek、retrieve不再需要像vector存储那样把数据搬回kCheapPrepend；只有容量不足时才会重新映射并拷贝
+     * @details prepend与可写区域共享环中的空闲空间
+     * @note 每个镜像缓冲区占2个内存映射，受vm.max_map_count限制，见TcpServer::setMirroredInputBuffer
+     * @return 系统不支持或映射失败时返回false，保持vector存储
+     */
+    bool useMirroredStorage(size_t capacity);
+
+    /**
+     * @brief 是否为镜像环形存储
+     */
+    bool mirrored() const { return ring_ != nullptr; }
+
     /**
      * @brief 可读的字节数
      */
@@ -45,19 +96,82 @@ public:
     /**
      * @brief 可写的字节数
      */
-    size_t writableBytes() const { return buf_.size() - writerIndex_; }
+    size_t writableBytes() const { return ring_? ringCapacity_ - readableBytes(): buf_.size() - writerIndex_; }
 
 
     /**
      * @brief 头部预留字节数
      */
-    size_t prependableBytes() const { return readerIndex_; }
+    size_t prependableBytes() const { return ring_? ringCapacity_ - readableBytes(): readerIndex_; }
 
     /**
      * @brief 可读的首索引
      */
     const char* peek() const { return begin() + readerIndex_; }
 
+    /**
+     * @brief 以网络字节序(大端)解析可读区开头的整数，不移动readidx
+     * @details 使用memcpy处理非对齐访问，编译后为一次load加一次bswap
+     */
+    int64_t peekInt64() const
+    {
+        assert(readableBytes() >= sizeof(int64_t));
+        int64_t be64 = 0;
+        ::memcpy(&be64, peek(), sizeof(be64));
+        return static_cast<int64_t>(be64toh(static_cast<uint64_t>(be64)));
+    }
+
+    int32_t peekInt32() const
+    {
+        assert(readableBytes() >= sizeof(int32_t));
+        int32_t be32 = 0;
+        ::memcpy(&be32, peek(), sizeof(be32));
+        return static_cast<int32_t>(be32toh(static_cast<uint32_t>(be32)));
+    }
+
+    int16_t peekInt16() const
+    {
+        assert(readableBytes() >= sizeof(int16_t));
+        int16_t be16 = 0;
+        ::memcpy(&be16, peek(), sizeof(be16));
+        return static_cast<int16_t>(be16toh(static_cast<uint16_t>(be16)));
+    }
+
+    int8_t peekInt8() const
+    {
+        assert(readableBytes() >= sizeof(int8_t));
+        int8_t x = *peek();
+        return x;
+    }
+
+    /**
+     * @brief 解析可读区开头的varint(每字节低7位为数据，最高位为后续标志)，不移动readidx
+     * @param[out] len varint占用的字节数
+     * @return 只有kVarintOk时才写入value与len
+     */
+    VarintResult peekVarint64(uint64_t* value, size_t* len) const
+    {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(peek());
+        const size_t readable = std::min(readableBytes(), kMaxVarint64Bytes);
+        uint64_t result = 0;
+        for(size_t i = 0; i < readable; ++i)
+        {
+            /// 第10字节只剩64位的最高1位
+            if(i == kMaxVarint64Bytes - 1 && p[i] > 1)
+            {
+                return kVarintMalformed;
+            }
+            result |= static_cast<uint64_t>(p[i] & 0x7f) << (7 * i);
+            if((p[i] & 0x80) == 0)
+            {
+                *value = result;
+                *len = i + 1;
+                return kVarintOk;
+            }
+        }
+        return readable == kMaxVarint64Bytes ? kVarintMalformed : kVarintIncomplete;
+    }
+
     /**
      * @brief 查找 \r\n开始的索引
      */
@@ -101,6 +215,11 @@ public:
         if(len < readableBytes())
         {
             readerIndex_ += len; 
+            if(ring_ && readerIndex_ >= ringCapacity_)
+            {
+                readerIndex_ -= ringCapacity_;
+                writerIndex_ -= ringCapacity_;
+            }
         }
         else
         {
@@ -133,13 +252,60 @@ public:
         retrieve(sizeof(int8_t));
     }
 
+    /**
+     * @brief 读取网络字节序(大端)的整数并更新readidx
+     * @note 调用前要求 readableBytes() >= sizeof(intN_t)
+     */
+    int64_t readInt64()
+    {
+        int64_t result = peekInt64();
+        retrieveInt64();
+        return result;
+    }
+
+    int32_t readInt32()
+    {
+        int32_t result = peekInt32();
+        retrieveInt32();
+        return result;
+    }
+
+    int16_t readInt16()
+    {
+        int16_t result = peekInt16();
+        retrieveInt16();
+        return result;
+    }
+
+    int8_t readInt8()
+    {
+        int8_t result = peekInt8();
+        retrieveInt8();
+        return result;
+    }
+
+    /**
+     * @brief 读取一个varint并更新readidx
+     * @return 不是kVarintOk时不移动readidx
+     */
+    VarintResult readVarint64(uint64_t* value)
+    {
+        size_t len = 0;
+        const VarintResult result = peekVarint64(value, &len);
+        if(result == kVarintOk)
+        {
+            retrieve(len);
+        }
+        return result;
+    }
+
     /**
      * @brief 重置readidx，wirteidx
      */
     void retrieveAll()
     {
-        readerIndex_ = kCheapPrepend;
-        writerIndex_ = kCheapPrepend;
+        readerIndex_ = ring_? 0: kCheapPrepend;
+        writerIndex_ = readerIndex_;
     }
 
     /**
@@ -175,6 +341,48 @@ public:
         append(static_cast<const char*>(data), len);
     }
 
+    /**
+     * @brief 以网络字节序(大端)追加整数
+     */
+    void appendInt64(int64_t x)
+    {
+        uint64_t be64 = htobe64(static_cast<uint64_t>(x));
+        append(&be64, sizeof(be64));
+    }
+
+    void appendInt32(int32_t x)
+    {
+        uint32_t be32 = htobe32(static_cast<uint32_t>(x));
+        append(&be32, sizeof(be32));
+    }
+
+    void appendInt16(int16_t x)
+    {
+        uint16_t be16 = htobe16(static_cast<uint16_t>(x));
+        append(&be16, sizeof(be16));
+    }
+
+    void appendInt8(int8_t x)
+    {
+        append(&x, sizeof(x));
+    }
+
+    /**
+     * @brief 以varint编码追加无符号整数，最多10字节
+     */
+    void appendVarint64(uint64_t x)
+    {
+        unsigned char buf[kMaxVarint64Bytes];
+        size_t len = 0;
+        while(x >= 0x80)
+        {
+            buf[len++] = static_cast<unsigned char>(x | 0x80);
+            x >>= 7;
+        }
+        buf[len++] = static_cast<unsigned char>(x);
+        append(buf, len);
+    }
+
     /**
      * @brief 更新写索引
      */
@@ -210,15 +418,48 @@ public:
      */
     void prepend(const void *data, size_t len)
     {
+        assert(len <= prependableBytes());
+        if(ring_ && readerIndex_ < len)
+        {
+            readerIndex_ += ringCapacity_;
+            writerIndex_ += ringCapacity_;
+        }
         readerIndex_ -=len;
         const char *d = static_cast<const char*>(data);
         std::copy(d, d+len, begin()+readerIndex_);
     }
 
+    /**
+     * @brief 以网络字节序(大端)向preprend空间写入整数，常用于在消息前补写长度头
+     * @note kCheapPrepend为8字节，最多可直接写入一个int64
+     */
+    void prependInt64(int64_t x)
+    {
+        uint64_t be64 = htobe64(static_cast<uint64_t>(x));
+        prepend(&be64, sizeof(be64));
+    }
+
+    void prependInt32(int32_t x)
+    {
+        uint32_t be32 = htobe32(static_cast<uint32_t>(x));
+        prepend(&be32, sizeof(be32));
+    }
+
+    void prependInt16(int16_t x)
+    {
+        uint16_t be16 = htobe16(static_cast<uint16_t>(x));
+        prepend(&be16, sizeof(be16));
+    }
+
+    void prependInt8(int8_t x)
+    {
+        prepend(&x, sizeof(x));
+    }
+
     /**
      * @brief buf容量
      */
-    size_t internalCapacity() const { return buf_.capacity();}
+    size_t internalCapacity() const { return ring_? ringCapacity_: buf_.capacity();}
 
     /**
      * @details fd是LT，没有循环读取完sockfd的数据，由于不知道socket缓冲区的大小，所以也就不确定buf_的大小，
@@ -230,13 +471,17 @@ public:
 
 private:
 
-    char *begin() { return &*buf_.begin(); }
-    const char* begin() const { return &*buf_.begin(); }
+    char *begin() { return ring_? ring_: &*buf_.begin(); }
+    const char* begin() const { return ring_? ring_: &*buf_.begin(); }
 
 
     void makeSpace(size_t len)
     {
-        if( writableBytes() + prependableBytes() < len + kCheapPrepend)
+        if(ring_)
+        {
+            growRing(readableBytes() + len);
+        }
+        else if( writableBytes() + prependableBytes() < len + kCheapPrepend)
         {
             buf_.resize(len + writerIndex_);
         }
@@ -253,9 +498,18 @@ private:
 
 
 
+    /**
+     * @brief 镜像环形存储容量不足时，重新映射至少capacity大小的区域并拷贝可读数据
+     */
+    void growRing(size_t capacity);
+
     std::vector<char> buf_;
+    /// 镜像环形存储时，readerIndex_始终小于ringCapacity_，writerIndex_ - readerIndex_ 不超过ringCapacity_
     size_t readerIndex_;
     size_t writerIndex_;
+    /// 镜像环形存储：2*ringCapacity_大小的虚拟地址，前后两半映射同一块物理内存；为nullptr时使用buf_
+    char* ring_;
+    size_t ringCapacity_;
 
     static const char kCRLF[];
 };
@@ -5,6 +5,8 @@
 
 #include <functional>
 #include <memory>
+#include <string>
+#include <stdint.h>
 
 
 namespace muduo_study
@@ -29,10 +31,23 @@ inline T* get_pointer(const std::unique_ptr<T>& ptr)
 class TcpConnection;
 using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
 using TimerCallback = std::function<void()>;
+/// 定时器的标识，用于取消定时器
+using TimerId = uint64_t;
 using ConnectionCallback = std::function<void(const TcpConnectionPtr&)>;
 using CloseCallback = std::function<void(const TcpConnectionPtr&)>;
 using WriteCompleteCallback = std::function<void(const TcpConnectionPtr&)>;
 using HighWaterMarkCallback = std::function<void(const TcpConnectionPtr&, size_t)>;
+using LowWaterMarkCallback = std::function<void(const TcpConnectionPtr&, size_t)>;
+
+/**
+ * @brief 输入缓冲区越过高水位线暂停读(paused为true)，或降到低水位线以下恢复读(paused为false)时的回调
+ */
+using InputWaterMarkCallback = std::function<void(const TcpConnectionPtr&, size_t readable, bool paused)>;
+
+/**
+ * @brief 引用计数的不可变发送数据，在内核或输出队列仍引用时保持有效
+ */
+using PayloadPtr = std::shared_ptr<const std::string>;
 
 /**
  * @brief 用户发送请求后的回调。
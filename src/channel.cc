@@ -21,7 +21,8 @@ Channel::Channel(EventLoop* loop, int fd)
     index_(-1),
     tied_(false),
     addedToLoop_(false),
-    eventHandling_(false)
+    eventHandling_(false),
+    keepRegistered_(false)
 {
 }
 
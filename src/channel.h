@@ -85,6 +85,13 @@ public:
     bool isWriting() const { return events_ & kWriteEvent; }
     bool isReading() const { return events_ & kReadEvent; }
 
+    /**
+     * @brief 没有关心的读写事件时是否仍留在epoll中，留在其中时仍能收到EPOLLERR/EPOLLHUP
+     * @details 默认没有事件时从epoll中删除；需要靠EPOLLERR读取错误队列(如MSG_ZEROCOPY完成通知)时开启
+     */
+    void setKeepRegistered(bool on) { keepRegistered_ = on; update(); }
+    bool keepRegistered() const { return keepRegistered_; }
+
     /**
      * @brief channel的状态
      */ 
@@ -140,6 +147,8 @@ private:
     bool addedToLoop_;
     /// 是否正在执行活跃事件对应的处理函数
     bool eventHandling_;
+    /// 没有读写事件时是否仍留在epoll中
+    bool keepRegistered_;
 
     /// 事件就绪时的回调处理函数，根据不同的类型调用对应的函数
     ReadEventCallback readCallback_;
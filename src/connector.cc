@@ -0,0 +1,248 @@
+#include "connector.h"
+#include "channel.h"
+#include "eventLoop.h"
+#include "logger.h"
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <sys/socket.h>
+
+
+namespace
+{
+
+/**
+ * @brief 对端地址与本端地址相同，说明连接到了本机未监听的临时端口上
+ */
+bool isSelfConnect(int sockfd)
+{
+    sockaddr_storage local, peer;
+    socklen_t localLen = static_cast<socklen_t>(sizeof(local));
+    socklen_t peerLen = static_cast<socklen_t>(sizeof(peer));
+    memset(&local, 0, sizeof(local));
+    memset(&peer, 0, sizeof(peer));
+    if(::getsockname(sockfd, (sockaddr*)&local, &localLen) < 0 || ::getpeername(sockfd, (sockaddr*)&peer, &peerLen) < 0)
+    {
+        return false;
+    }
+    if(local.ss_family == AF_INET)
+    {
+        const sockaddr_in* l = (const sockaddr_in*)&local;
+        const sockaddr_in* r = (const sockaddr_in*)&peer;
+        return l->sin_port == r->sin_port && l->sin_addr.s_addr == r->sin_addr.s_addr;
+    }
+    if(local.ss_family == AF_INET6)
+    {
+        const sockaddr_in6* l = (const sockaddr_in6*)&local;
+        const sockaddr_in6* r = (const sockaddr_in6*)&peer;
+        return l->sin6_port == r->sin6_port && memcmp(&l->sin6_addr, &r->sin6_addr, sizeof(l->sin6_addr)) == 0;
+    }
+    return false;
+}
+
+} // namespace
+
+
+namespace muduo_study
+{
+
+Connector::Connector(EventLoop* loop, const InetAddress& serverAddr)
+    : loop_(loop),
+    serverAddr_(serverAddr),
+    connect_(false),
+    state_(kDisconnected),
+    initRetryDelay_(0.5),
+    maxRetryDelay_(30),
+    retryDelay_(0.5),
+    retryTimer_(0)
+{
+}
+
+Connector::~Connector()
+{
+    if(channel_)
+    {
+        LOG_ERROR("Connector to %s destroyed while connecting", serverAddr_.toIpPort().c_str());
+    }
+}
+
+void Connector::start()
+{
+    connect_ = true;
+    loop_->runInloop(
+        std::bind(&Connector::startInLoop, shared_from_this())
+    );
+}
+
+void Connector::startInLoop()
+{
+    retryTimer_ = 0;
+    if(connect_ && state_ == kDisconnected)
+    {
+        connect();
+    }
+}
+
+void Connector::restart()
+{
+    setState(kDisconnected);
+    retryDelay_ = initRetryDelay_;
+    connect_ = true;
+    startInLoop();
+}
+
+void Connector::stop()
+{
+    connect_ = false;
+    loop_->runInloop(
+        std::bind(&Connector::stopInLoop, shared_from_this())
+    );
+}
+
+void Connector::stopInLoop()
+{
+    if(retryTimer_ != 0)
+    {
+        loop_->cancel(retryTimer_);
+        retryTimer_ = 0;
+    }
+    if(state_ == kConnecting)
+    {
+        /// connect_已为false，retry只关闭socket不再安排重连
+        retry(removeAndResetChannel());
+    }
+}
+
+void Connector::connect()
+{
+    const int protocol = serverAddr_.isUnix()? 0: IPPROTO_TCP;
+    int sockfd = ::socket(serverAddr_.family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, protocol);
+    if(sockfd < 0)
+    {
+        LOG_ERROR("Connector::connect socket error %d", errno);
+        return ;
+    }
+
+    int ret = ::connect(sockfd, serverAddr_.getSockAddr(), serverAddr_.length());
+    int savedErrno = (ret == 0)? 0: errno;
+    switch(savedErrno)
+    {
+        case 0:
+        case EINPROGRESS:
+        case EINTR:
+        case EISCONN:
+            connecting(sockfd);
+            break;
+
+        /// 暂时性错误，稍后重试；Unix domain socket的服务端未启动时返回ENOENT
+        case EAGAIN:
+        case EADDRINUSE:
+        case EADDRNOTAVAIL:
+        case ECONNREFUSED:
+        case ENETUNREACH:
+        case ENOENT:
+            retry(sockfd);
+            break;
+
+        default:
+            LOG_ERROR("Connector::connect to %s error %d", serverAddr_.toIpPort().c_str(), savedErrno);
+            ::close(sockfd);
+            break;
+    }
+}
+
+void Connector::connecting(int sockfd)
+{
+    setState(kConnecting);
+    channel_.reset(new Channel(loop_, sockfd));
+    channel_->setWriteCallback(
+        std::bind(&Connector::handleWrite, this)
+    );
+    channel_->setErrorCallback(
+        std::bind(&Connector::handleError, this)
+    );
+    channel_->enableWriting();
+}
+
+int Connector::removeAndResetChannel()
+{
+    channel_->disableAll();
+    channel_->remove();
+    int sockfd = channel_->fd();
+    /// 当前可能正处于channel_->handleEvent中，不能在这里释放channel_
+    loop_->queueInloop(
+        std::bind(&Connector::resetChannel, shared_from_this())
+    );
+    return sockfd;
+}
+
+void Connector::resetChannel()
+{
+    channel_.reset();
+}
+
+void Connector::handleWrite()
+{
+    if(state_ != kConnecting)
+    {
+        return ;
+    }
+
+    int sockfd = removeAndResetChannel();
+    int optval = 0;
+    socklen_t optlen = static_cast<socklen_t>(sizeof(optval));
+    if(::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    {
+        optval = errno;
+    }
+
+    if(optval != 0)
+    {
+        LOG_ERROR("Connector::handleWrite connect to %s error %d", serverAddr_.toIpPort().c_str(), optval);
+        retry(sockfd);
+    }
+    else if(isSelfConnect(sockfd))
+    {
+        LOG_ERROR("Connector::handleWrite self connect to %s", serverAddr_.toIpPort().c_str());
+        retry(sockfd);
+    }
+    else
+    {
+        setState(kConnected);
+        retryDelay_ = initRetryDelay_;
+        if(connect_ && newConnectionCallback_)
+        {
+            newConnectionCallback_(sockfd);
+        }
+        else
+        {
+            ::close(sockfd);
+        }
+    }
+}
+
+void Connector::handleError()
+{
+    if(state_ == kConnecting)
+    {
+        retry(removeAndResetChannel());
+    }
+}
+
+void Connector::retry(int sockfd)
+{
+    ::close(sockfd);
+    setState(kDisconnected);
+    if(connect_)
+    {
+        LOG_INFO("Connector retry connecting to %s in %.3f seconds", serverAddr_.toIpPort().c_str(), retryDelay_);
+        retryTimer_ = loop_->runAfter(retryDelay_,
+            std::bind(&Connector::startInLoop, shared_from_this())
+        );
+        retryDelay_ = std::min(retryDelay_ * 2, maxRetryDelay_);
+    }
+}
+
+} // namespace muduo_study
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "nocopyable.h"
+#include "callback.h"
+#include "inetAddress.h"
+
+#include <functional>
+#include <memory>
+#include <atomic>
+
+
+namespace muduo_study
+{
+
+class EventLoop;
+class Channel;
+
+/**
+ * @brief 主动发起连接，与Acceptor相对
+ * @details 非阻塞connect后注册写事件，socket可写时通过SO_ERROR判断连接是否成功；
+ * @details 失败时关闭socket，按指数退避延迟后在loop定时器中重试，成功后把sockfd交给newConnectionCallback_
+ * @note 只负责建立连接，不持有已建立的连接；除start/stop外只在loop线程中访问
+ */
+class Connector: nocopyable,
+    public std::enable_shared_from_this<Connector>
+{
+public:
+    using NewConnectionCallback = std::function<void(int sockfd)>;
+
+    Connector(EventLoop* loop, const InetAddress& serverAddr);
+    ~Connector();
+
+    void setNewConnectionCallback(const NewConnectionCallback& cb) { newConnectionCallback_ = cb; }
+
+    /**
+     * @brief 重试的初始延迟与最大延迟，单位秒，每次失败延迟翻倍
+     */
+    void setRetryDelay(double initial, double max) { initRetryDelay_ = initial; maxRetryDelay_ = max; retryDelay_ = initial; }
+
+    const InetAddress& serverAddress() const { return serverAddr_; }
+
+    /**
+     * @brief 开始连接，可在任意线程调用
+     */
+    void start();
+
+    /**
+     * @brief 连接断开后重新连接，重置退避延迟，只能在loop线程调用
+     */
+    void restart();
+
+    /**
+     * @brief 停止连接以及等待中的重试，可在任意线程调用
+     */
+    void stop();
+
+private:
+    enum States
+    {
+        kDisconnected,
+        kConnecting,
+        kConnected
+    };
+
+    void setState(States s) { state_ = s; }
+    void startInLoop();
+    void stopInLoop();
+    void connect();
+
+    /**
+     * @brief connect返回EINPROGRESS，注册写事件等待连接完成
+     */
+    void connecting(int sockfd);
+
+    /**
+     * @brief socket可写或出错，检查SO_ERROR和自连接
+     */
+    void handleWrite();
+    void handleError();
+
+    /**
+     * @brief 关闭sockfd，按退避延迟安排下一次连接
+     */
+    void retry(int sockfd);
+
+    /**
+     * @brief 从poller中移除channel_并返回其fd；channel_在handleEvent返回后才能释放
+     */
+    int removeAndResetChannel();
+    void resetChannel();
+
+    EventLoop* loop_;
+    const InetAddress serverAddr_;
+    /// 用户是否希望连接，stop后为false
+    std::atomic_bool connect_;
+    States state_;
+    /// 正在连接中的socket对应的channel
+    std::unique_ptr<Channel> channel_;
+    NewConnectionCallback newConnectionCallback_;
+    double initRetryDelay_;
+    double maxRetryDelay_;
+    double retryDelay_;
+    TimerId retryTimer_;
+};
+
+using ConnectorPtr = std::shared_ptr<Connector>;
+
+} // namespace muduo_study
@@ -89,7 +89,7 @@ void Eepoller::updateChannel(Channel* channel)
     }
     else
     {
-        if(channel->isNoneEvent())
+        if(channel->isNoneEvent() && !channel->keepRegistered())
         {
             update(EPOLL_CTL_DEL, channel);
             channel->set_index(kDeleted);
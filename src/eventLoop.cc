@@ -2,10 +2,12 @@
 #include "logger.h"
 #include "poller.h"
 #include "channel.h"
+#include "timerQueue.h"
 
 #include <sys/eventfd.h>
 #include <signal.h>
 #include <memory>
+#include <algorithm>
 
 namespace
 {
@@ -51,6 +53,7 @@ EventLoop::EventLoop()
     poller_(Poller::newDefaultPoller(this)),
     wakeupFd_(createEventfd()),
     wakeupChannel_(new Channel(this, wakeupFd_)),
+    timerQueue_(new TimerQueue(this)),
     curtentActiveChannel_(nullptr)
 {
     if(t_loopInThisThread)
@@ -91,6 +94,14 @@ void EventLoop::loop()
         activeChannels_.clear();
 
         pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+        if(!nextBeforePollFunctors_.empty())
+        {
+            for(Functor& functor: nextBeforePollFunctors_)
+            {
+                beforePollFunctors_.emplace_back(std::move(functor));
+            }
+            nextBeforePollFunctors_.clear();
+        }
 
         for(Channel* channel: activeChannels_)
         {
@@ -136,14 +147,14 @@ void EventLoop::runInloop(Functor cb)
     }
     else
     {
-        queueInloop(cb);
+        queueInloop(std::move(cb));
     }
 }
 
 void EventLoop::queueInloop(Functor cb)
 {
     std::unique_lock<std::mutex> lock(mutex_);
-    pendingFunctors_.emplace_back(cb);
+    pendingFunctors_.emplace_back(std::move(cb));
 
     /**
      * @details 因为添加了新的回调，然后因为当前正在执行，因为唤醒，所以epoll返回，所以需要唤醒执行回调函数
@@ -157,6 +168,33 @@ void EventLoop::queueInloop(Functor cb)
 
 
 
+void EventLoop::runBeforePoll(Functor cb)
+{
+    beforePollFunctors_.emplace_back(std::move(cb));
+}
+
+void EventLoop::runBeforeNextPoll(Functor cb)
+{
+    nextBeforePollFunctors_.emplace_back(std::move(cb));
+}
+
+TimerId EventLoop::runAfter(double delay, TimerCallback cb)
+{
+    const int64_t when = TimerQueue::now() + static_cast<int64_t>(delay * 1000000);
+    return timerQueue_->addTimer(std::move(cb), when, 0);
+}
+
+TimerId EventLoop::runEvery(double interval, TimerCallback cb)
+{
+    const int64_t intervalUs = std::max<int64_t>(static_cast<int64_t>(interval * 1000000), 1);
+    return timerQueue_->addTimer(std::move(cb), TimerQueue::now() + intervalUs, intervalUs);
+}
+
+void EventLoop::cancel(TimerId timerId)
+{
+    timerQueue_->cancel(timerId);
+}
+
 void EventLoop::updateChannel(Channel* channel)
 {
     
@@ -204,6 +242,20 @@ void EventLoop::doPendingFunctors()
         functor();
     }
 
+    /**
+     * @note 在callingPendingFunctors_仍为true时执行，其中queueInloop的回调会唤醒下一轮poll立即返回
+     * @note 执行期间再次登记的cb(如flush中触发的send)在本次poll之前继续执行，否则要等到下一次事件或poll超时
+     */
+    while(!beforePollFunctors_.empty())
+    {
+        functors.clear();
+        functors.swap(beforePollFunctors_);
+        for(const Functor& functor: functors)
+        {
+            functor();
+        }
+    }
+
     callingPendingFunctors_ = false;
 }
 
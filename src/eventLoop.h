@@ -3,6 +3,7 @@
 #include "timestamp.h"
 #include "nocopyable.h"
 #include "currentThread.h"
+#include "callback.h"
 
 #include <functional>
 #include <vector>
@@ -18,6 +19,7 @@ namespace muduo_study
 
 class Channel;
 class Poller;
+class TimerQueue;
 
 
 /**
@@ -64,6 +66,33 @@ public:
      */
     void queueInloop(Functor cb);
 
+    /**
+     * @brief 登记在本轮loop结束时执行的cb：在doPendingFunctors之后、下一次poll之前执行，只能在loop线程调用
+     * @note 用于写合并，使一轮loop中的多次send只触发一次flush；在这些cb执行期间登记的cb也在本次poll之前执行，直到没有新登记的cb
+     */
+    void runBeforePoll(Functor cb);
+
+    /**
+     * @brief 登记在下一轮loop结束时执行的cb，不唤醒loop，只能在loop线程调用
+     * @note 用于需要每轮loop检查一次的状态(如输入暂停后的低水位检查)，cb可以在执行时重新登记自己而不会空转
+     */
+    void runBeforeNextPoll(Functor cb);
+
+    /**
+     * @brief 在delay秒后执行cb，可在任意线程调用，cb在loop线程中执行
+     */
+    TimerId runAfter(double delay, TimerCallback cb);
+
+    /**
+     * @brief 每隔interval秒执行一次cb，可在任意线程调用
+     */
+    TimerId runEvery(double interval, TimerCallback cb);
+
+    /**
+     * @brief 取消定时器，可在任意线程调用
+     */
+    void cancel(TimerId timerId);
+
     /**
      * @brief 唤醒当前eventloop，通过写入数据，触发可读事件，然后执行doPendingFunctors
      */
@@ -110,6 +139,8 @@ private:
     /// 该fd作用是通过向该fd写入数据，使得epoll_wait可以立刻返回，因为epoll_wait 有10秒的超时时间。
     int wakeupFd_;
     std::unique_ptr<Channel> wakeupChannel_;  
+    /// 定时器队列，timerfd同样注册在poller_中
+    std::unique_ptr<TimerQueue> timerQueue_;
 
     /// 调用poller_::poll所传入的参数，可得到当前活跃的channel
     ChannelList activeChannels_;    
@@ -119,6 +150,10 @@ private:
     std::atomic_bool callingPendingFunctors_;  
     /// 存储的PendingFunctors
     std::vector<Functor> pendingFunctors_;
+    /// 本轮loop结束时执行的回调，只在loop线程访问，不需要加锁
+    std::vector<Functor> beforePollFunctors_;
+    /// 下一轮loop结束时执行的回调，poll返回后并入beforePollFunctors_
+    std::vector<Functor> nextBeforePollFunctors_;
     //保证PendingFunctors线程安全。
     std::mutex mutex_;    
 };
@@ -5,31 +5,199 @@
 #include<arpa/inet.h>
 #include<string>
 #include<string.h>
+#include<stddef.h>
+#include<algorithm>
+
+
+namespace
+{
+
+/**
+ * @brief 把port的十进制追加到buf[pos]，返回新的长度，空间不足时截断
+ */
+size_t appendPort(char* buf, size_t size, size_t pos, uint16_t port)
+{
+    char digits[8];
+    size_t n = 0;
+    do
+    {
+        digits[n++] = static_cast<char>('0' + port % 10);
+        port = static_cast<uint16_t>(port / 10);
+    } while(port > 0);
+
+    while(n > 0 && pos + 1 < size)
+    {
+        buf[pos++] = digits[--n];
+    }
+    buf[pos] = '\0';
+    return pos;
+}
+
+/**
+ * @brief 把len字节追加到buf[pos]，返回新的长度，空间不足时截断
+ */
+size_t appendBytes(char* buf, size_t size, size_t pos, const char* data, size_t len)
+{
+    const size_t n = std::min(len, size - 1 - pos);
+    memcpy(buf + pos, data, n);
+    pos += n;
+    buf[pos] = '\0';
+    return pos;
+}
+
+} // namespace
 
 
 namespace muduo_study
 {
 
+const size_t InetAddress::kMaxStringLength;
+
+InetAddress::InetAddress()
+    : len_(sizeof(addr_))
+{
+    bzero(&addr_, sizeof(addr_));
+}
+
 InetAddress::InetAddress(uint16_t port, std::string ip)
 {
     bzero(&addr_, sizeof(addr_));
-    addr_.sin_family = AF_INET;
-    addr_.sin_port = htons(port);
-    addr_.sin_addr.s_addr = inet_addr(ip.c_str());
+    if(ip.find(':') != std::string::npos)
+    {
+        len_ = sizeof(sockaddr_in6);
+        addr_.in6.sin6_family = AF_INET6;
+        addr_.in6.sin6_port = htons(port);
+        ::inet_pton(AF_INET6, ip.c_str(), &addr_.in6.sin6_addr);
+    }
+    else
+    {
+        len_ = sizeof(sockaddr_in);
+        addr_.in.sin_family = AF_INET;
+        addr_.in.sin_port = htons(port);
+        ::inet_pton(AF_INET, ip.c_str(), &addr_.in.sin_addr);
+    }
+}
+
+InetAddress::InetAddress(const sockaddr* addr, socklen_t len)
+{
+    setSockAddr(addr, len);
+}
+
+InetAddress InetAddress::fromUnixPath(const std::string& path)
+{
+    InetAddress addr;
+    addr.addr_.un.sun_family = AF_UNIX;
+    /// 抽象地址以'\0'开头，长度精确到名字结尾，不包含结尾的'\0'
+    const size_t len = std::min(path.size(), sizeof(addr.addr_.un.sun_path) - 1);
+    memcpy(addr.addr_.un.sun_path, path.data(), len);
+    if(!path.empty() && path[0] == '@')
+    {
+        addr.addr_.un.sun_path[0] = '\0';
+        addr.len_ = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + len);
+    }
+    else
+    {
+        addr.len_ = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + len + 1);
+    }
+    return addr;
+}
+
+void InetAddress::setSockAddr(const sockaddr* addr, socklen_t len)
+{
+    bzero(&addr_, sizeof(addr_));
+    len_ = std::min(len, static_cast<socklen_t>(sizeof(addr_)));
+    memcpy(&addr_, addr, len_);
+}
+
+uint16_t InetAddress::port() const
+{
+    switch(family())
+    {
+        case AF_INET:
+            return ntohs(addr_.in.sin_port);
+        case AF_INET6:
+            return ntohs(addr_.in6.sin6_port);
+        default:
+            return 0;
+    }
+}
+
+size_t InetAddress::toIp(char* buf, size_t size) const
+{
+    if(size == 0)
+    {
+        return 0;
+    }
+    buf[0] = '\0';
+
+    if(isUnix())
+    {
+        const size_t pathLen = len_ > offsetof(sockaddr_un, sun_path)? len_ - offsetof(sockaddr_un, sun_path): 0;
+        if(pathLen == 0)
+        {
+            return 0;
+        }
+        if(addr_.un.sun_path[0] == '\0')
+        {
+            size_t pos = appendBytes(buf, size, 0, "@", 1);
+            return appendBytes(buf, size, pos, addr_.un.sun_path + 1, pathLen - 1);
+        }
+        return appendBytes(buf, size, 0, addr_.un.sun_path, strnlen(addr_.un.sun_path, pathLen));
+    }
+
+    char ip[INET6_ADDRSTRLEN];
+    const void* src = isIpv6()? static_cast<const void*>(&addr_.in6.sin6_addr): static_cast<const void*>(&addr_.in.sin_addr);
+    if(::inet_ntop(family(), src, ip, sizeof(ip)) == NULL)
+    {
+        return 0;
+    }
+    return appendBytes(buf, size, 0, ip, strlen(ip));
+}
+
+size_t InetAddress::toIpPort(char* buf, size_t size) const
+{
+    if(size == 0)
+    {
+        return 0;
+    }
+
+    if(isUnix())
+    {
+        size_t pos = appendBytes(buf, size, 0, "unix:", 5);
+        return pos + toIp(buf + pos, size - pos);
+    }
+
+    size_t pos = 0;
+    if(isIpv6())
+    {
+        pos = appendBytes(buf, size, pos, "[", 1);
+    }
+    pos += toIp(buf + pos, size - pos);
+    if(isIpv6())
+    {
+        pos = appendBytes(buf, size, pos, "]", 1);
+    }
+    pos = appendBytes(buf, size, pos, ":", 1);
+    return appendPort(buf, size, pos, port());
 }
 
 std::string InetAddress::toIp() const
 {
-    return inet_ntoa(addr_.sin_addr);
+    char buf[kMaxStringLength];
+    size_t n = toIp(buf, sizeof(buf));
+    return std::string(buf, n);
 }
 
 std::string InetAddress::toPort() const
 {
-    return std::to_string(ntohs(addr_.sin_port));
+    return std::to_string(port());
 }
+
 std::string InetAddress::toIpPort() const
 {
-    return toIp() + ":" + toPort();
+    char buf[kMaxStringLength];
+    size_t n = toIpPort(buf, sizeof(buf));
+    return std::string(buf, n);
 }
     
 } // namespace muduo_study
@@ -3,6 +3,7 @@
 #include<netinet/in.h>
 #include<string>
 #include<sys/socket.h>
+#include<sys/un.h>
 
 
 namespace muduo_study
@@ -10,23 +11,66 @@ namespace muduo_study
 
 /**
  * @brief 网络地址封装类
+ * @details 可以保存IPv4、IPv6以及AF_UNIX地址：Unix地址为以'/'开头的文件路径，或以'@'开头的抽象地址(Linux)，
+ * @details 使TcpServer/Acceptor/TcpConnection可以不加修改地工作在这几种地址族上
  */
 class InetAddress
 {
 public:
+    /// toIpPort(char*, size_t)所需的最大缓冲区长度，包括结尾的'\0'
+    static const size_t kMaxStringLength = 128;
+
+    InetAddress();
+    /**
+     * @param[in] ip 点分十进制的IPv4地址，或IPv6地址(含':'，如"::"、"::1")
+     */
     explicit InetAddress(uint16_t port, std::string ip="127.0.0.1");
-    explicit InetAddress(sockaddr_in& addr): addr_(addr) {}
+    explicit InetAddress(sockaddr_in& addr): len_(sizeof(sockaddr_in)) { addr_.in = addr; }
+    explicit InetAddress(const sockaddr_in6& addr): len_(sizeof(sockaddr_in6)) { addr_.in6 = addr; }
+
+    /**
+     * @brief 由任意sockaddr构造，len为地址的实际长度(accept/getsockname的返回值)
+     */
+    InetAddress(const sockaddr* addr, socklen_t len);
+
+    /**
+     * @brief Unix domain socket地址，path以'@'开头时为抽象地址，不在文件系统中创建文件
+     */
+    static InetAddress fromUnixPath(const std::string& path);
+
+    sa_family_t family() const {return addr_.in.sin_family;}
+    bool isUnix() const { return family() == AF_UNIX; }
+    bool isIpv6() const { return family() == AF_INET6; }
+    /// Unix地址是否为抽象地址
+    bool isAbstractUnix() const { return isUnix() && len_ > sizeof(sa_family_t) && addr_.un.sun_path[0] == '\0'; }
 
-    sa_family_t family() const {return addr_.sin_family;}
+    /**
+     * @brief 把地址格式化到调用者提供的缓冲区，不分配内存，返回写入的长度(不含'\0')，缓冲区不足时截断
+     * @details IPv4为"a.b.c.d:port"，IPv6为"[addr]:port"，Unix地址为"unix:path"
+     */
+    size_t toIp(char* buf, size_t size) const;
+    size_t toIpPort(char* buf, size_t size) const;
+
+    /**
+     * @brief IP地址与端口；Unix地址的toIp返回路径(抽象地址以'@'开头，未命名的对端为空)，端口为0
+     */
     std::string toIp() const;
     std::string toPort() const;
     std::string toIpPort() const;
+    uint16_t port() const;
     sockaddr* getSockAddr() const { return (sockaddr*)&addr_;};
-    void setSockAddr(sockaddr_in& addr) {addr_ = addr;}
+    /// 传给bind/connect的地址长度
+    socklen_t length() const { return len_; }
+    void setSockAddr(sockaddr_in& addr) { addr_.in = addr; len_ = sizeof(sockaddr_in); }
+    void setSockAddr(const sockaddr* addr, socklen_t len);
 private:
-    sockaddr_in addr_;
+    union
+    {
+        sockaddr_in in;
+        sockaddr_in6 in6;
+        sockaddr_un un;
+    } addr_;
+    socklen_t len_;
 };
 
 } // namespace muduo_study
-
-
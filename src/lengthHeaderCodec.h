@@ -0,0 +1,139 @@
+#pragma once
+
+#include "nocopyable.h"
+#include "callback.h"
+#include "buffer.h"
+#include "tcpConnection.h"
+#include "logger.h"
+
+#include <functional>
+#include <limits>
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+
+
+namespace muduo_study
+{
+
+/**
+ * @brief 长度头部的字节序转换，按头部宽度重载，编译后为一次load加一次bswap
+ */
+namespace detail
+{
+inline uint8_t headerToHost(uint8_t x, bool) { return x; }
+inline uint16_t headerToHost(uint16_t x, bool bigEndian) { return bigEndian? be16toh(x): le16toh(x); }
+inline uint32_t headerToHost(uint32_t x, bool bigEndian) { return bigEndian? be32toh(x): le32toh(x); }
+inline uint64_t headerToHost(uint64_t x, bool bigEndian) { return bigEndian? be64toh(x): le64toh(x); }
+
+inline uint8_t hostToHeader(uint8_t x, bool) { return x; }
+inline uint16_t hostToHeader(uint16_t x, bool bigEndian) { return bigEndian? htobe16(x): htole16(x); }
+inline uint32_t hostToHeader(uint32_t x, bool bigEndian) { return bigEndian? htobe32(x): htole32(x); }
+inline uint64_t hostToHeader(uint64_t x, bool bigEndian) { return bigEndian? htobe64(x): htole64(x); }
+} // namespace detail
+
+/**
+ * @brief 长度头部分帧的编解码器
+ * @details 每帧为 [长度头部][消息体]，长度头部只记录消息体的长度。
+ * @details 接收时从inputBuffer_中解析出完整的帧，以指向缓冲区内部的指针交给用户，不做拷贝；
+ * @details 发送时把长度头部写入Buff的prepend空间，头部和消息体由一次write发出。
+ * @param HeaderType 长度头部的类型，uint8_t/uint16_t/uint32_t/uint64_t
+ * @param kBigEndian 长度头部是否为网络字节序(大端)
+ */
+template<typename HeaderType = uint32_t, bool kBigEndian = true>
+class LengthHeaderCodec: nocopyable
+{
+public:
+    static_assert(sizeof(HeaderType) <= Buff::kCheapPrepend, "header must fit in Buff::kCheapPrepend");
+
+    /**
+     * @brief 收到完整帧后的回调
+     * @note data指向inputBuffer_内部，只在回调期间有效，回调返回后该帧即被retrieve
+     */
+    using FrameCallback = std::function<void(const TcpConnectionPtr&, const char* data, size_t len, Timestamp)>;
+
+    static const size_t kHeaderLen = sizeof(HeaderType);
+
+    /**
+     * @param[in] maxFrameSize 消息体的最大长度，超出则认为对端协议错误并关闭连接；不超过HeaderType能表示的最大值
+     */
+    explicit LengthHeaderCodec(const FrameCallback& cb, size_t maxFrameSize = 64*1024*1024)
+    : frameCallback_(cb),
+    maxFrameSize_(static_cast<size_t>(std::min<uint64_t>(maxFrameSize, std::numeric_limits<HeaderType>::max())))
+    {
+    }
+
+    /**
+     * @brief 作为MessageCallback绑定到TcpServer/TcpConnection
+     * @details 循环解析inputBuffer_中所有完整的帧，不完整的帧留在缓冲区等待下次数据到达
+     */
+    void onMessage(const TcpConnectionPtr& conn, Buff* buf, Timestamp receiveTime)
+    {
+        while(buf->readableBytes() >= kHeaderLen)
+        {
+            HeaderType header;
+            ::memcpy(&header, buf->peek(), kHeaderLen);
+            const uint64_t len = detail::headerToHost(header, kBigEndian);
+            if(len > maxFrameSize_)
+            {
+                LOG_ERROR("%s invalid frame length %lu", conn->name().c_str(), static_cast<unsigned long>(len));
+                buf->retrieveAll();
+                conn->shutdown();
+                break;
+            }
+            /// len已不超过maxFrameSize_，与可读的消息体长度比较，避免kHeaderLen + len在64位头部下回绕
+            else if(buf->readableBytes() - kHeaderLen >= len)
+            {
+                frameCallback_(conn, buf->peek() + kHeaderLen, static_cast<size_t>(len), receiveTime);
+                buf->retrieve(kHeaderLen + static_cast<size_t>(len));
+            }
+            else
+            {
+                break;
+            }
+        }
+    }
+
+    /**
+     * @brief 发送一帧，消息体为body的可读数据
+     * @details 长度头部写入body的prepend空间，随后整个body被发送并清空
+     * @return 消息体超过maxFrameSize时不发送，记录日志并返回false，body保持不变
+     */
+    bool send(const TcpConnectionPtr& conn, Buff* body)
+    {
+        if(body->readableBytes() > maxFrameSize_)
+        {
+            LOG_ERROR("%s frame length %lu exceeds max %lu", conn->name().c_str(),
+                      static_cast<unsigned long>(body->readableBytes()), static_cast<unsigned long>(maxFrameSize_));
+            return false;
+        }
+        HeaderType header = detail::hostToHeader(static_cast<HeaderType>(body->readableBytes()), kBigEndian);
+        body->prepend(&header, kHeaderLen);
+        conn->send(body);
+        return true;
+    }
+
+    bool send(const TcpConnectionPtr& conn, const void* data, size_t len)
+    {
+        if(len > maxFrameSize_)
+        {
+            LOG_ERROR("%s frame length %lu exceeds max %lu", conn->name().c_str(),
+                      static_cast<unsigned long>(len), static_cast<unsigned long>(maxFrameSize_));
+            return false;
+        }
+        Buff buf;
+        buf.append(data, len);
+        return send(conn, &buf);
+    }
+
+    size_t maxFrameSize() const { return maxFrameSize_; }
+
+private:
+    FrameCallback frameCallback_;
+    const size_t maxFrameSize_;
+};
+
+template<typename HeaderType, bool kBigEndian>
+const size_t LengthHeaderCodec<HeaderType, kBigEndian>::kHeaderLen;
+
+} // namespace muduo_study
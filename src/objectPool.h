@@ -0,0 +1,154 @@
+#pragma once
+
+#include "nocopyable.h"
+
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <cstddef>
+
+
+namespace muduo_study
+{
+
+/**
+ * @brief 定长内存块池
+ * @details 释放的内存块放入空闲链表，下次分配时直接复用，不再经过malloc。
+ * @details 块大小由第一次分配决定，之后大小不同的请求直接走operator new。
+ * @note 分配和释放可能发生在不同线程(例如mainloop中创建、ioloop中销毁)，空闲链表由互斥锁保护，
+ * @note 正常情况下同一时刻只有一个线程访问，加锁开销很小
+ */
+class FixedBlockPool: nocopyable
+{
+public:
+    /**
+     * @param[in] maxCached 最多缓存的空闲块数量，超出部分直接释放
+     */
+    explicit FixedBlockPool(size_t maxCached = 4096)
+    : blockSize_(0),
+    maxCached_(maxCached),
+    hits_(0),
+    misses_(0)
+    {
+    }
+
+    ~FixedBlockPool()
+    {
+        for(void* block: freeList_)
+        {
+            ::operator delete(block);
+        }
+    }
+
+    void* allocate(size_t size)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if(blockSize_ == 0)
+            {
+                blockSize_ = size;
+            }
+            if(size == blockSize_ && !freeList_.empty())
+            {
+                void* block = freeList_.back();
+                freeList_.pop_back();
+                ++hits_;
+                return block;
+            }
+            ++misses_;
+        }
+        return ::operator new(size);
+    }
+
+    void deallocate(void* block, size_t size)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if(size == blockSize_ && freeList_.size() < maxCached_)
+            {
+                freeList_.push_back(block);
+                return ;
+            }
+        }
+        ::operator delete(block);
+    }
+
+    size_t blockSize() const { std::unique_lock<std::mutex> lock(mutex_); return blockSize_; }
+    size_t cachedBlocks() const { std::unique_lock<std::mutex> lock(mutex_); return freeList_.size(); }
+    /// 命中空闲链表和走operator new的分配次数
+    size_t hits() const { std::unique_lock<std::mutex> lock(mutex_); return hits_; }
+    size_t misses() const { std::unique_lock<std::mutex> lock(mutex_); return misses_; }
+
+private:
+    mutable std::mutex mutex_;
+    size_t blockSize_;
+    const size_t maxCached_;
+    std::vector<void*> freeList_;
+    size_t hits_;
+    size_t misses_;
+};
+
+using FixedBlockPoolPtr = std::shared_ptr<FixedBlockPool>;
+
+/**
+ * @brief 从FixedBlockPool分配的标准分配器，用于std::allocate_shared
+ * @details allocate_shared会把分配器rebind到内部控制块类型，对象与控制块一次分配在同一块内存中；
+ * @details 分配器持有池的shared_ptr并被拷贝进控制块，因此池的生命周期不短于池中分配出的任何对象
+ */
+template<typename T>
+class PoolAllocator
+{
+public:
+    using value_type = T;
+
+    explicit PoolAllocator(const FixedBlockPoolPtr& pool)
+    : pool_(pool)
+    {
+    }
+
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U>& rhs)
+    : pool_(rhs.pool())
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned type");
+        if(n != 1)
+        {
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+        return static_cast<T*>(pool_->allocate(sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        if(n != 1)
+        {
+            ::operator delete(p);
+            return ;
+        }
+        pool_->deallocate(p, sizeof(T));
+    }
+
+    const FixedBlockPoolPtr& pool() const { return pool_; }
+
+private:
+    FixedBlockPoolPtr pool_;
+};
+
+template<typename T, typename U>
+bool operator==(const PoolAllocator<T>& lhs, const PoolAllocator<U>& rhs)
+{
+    return lhs.pool() == rhs.pool();
+}
+
+template<typename T, typename U>
+bool operator!=(const PoolAllocator<T>& lhs, const PoolAllocator<U>& rhs)
+{
+    return !(lhs == rhs);
+}
+
+} // namespace muduo_study
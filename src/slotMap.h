@@ -0,0 +1,152 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+
+namespace muduo_study
+{
+
+/**
+ * @brief 以64位id索引的slot map
+ * @details id的低32位为槽位下标，高32位为该槽位的代数(generation)。槽位释放时代数加1，
+ * @details 因此旧id不会误删或查到复用该槽位的新元素。插入、删除、查找都是O(1)，不分配字符串也不做比较。
+ * @note 非线程安全，由使用者保证在同一个线程中访问
+ */
+template<typename T>
+class SlotMap
+{
+public:
+    SlotMap()
+    : size_(0)
+    {
+    }
+
+    /**
+     * @brief 插入value，返回其id
+     */
+    uint64_t insert(const T& value)
+    {
+        uint32_t index;
+        if(freeList_.empty())
+        {
+            index = static_cast<uint32_t>(slots_.size());
+            slots_.push_back(Slot());
+        }
+        else
+        {
+            index = freeList_.back();
+            freeList_.pop_back();
+        }
+        Slot& slot = slots_[index];
+        slot.value = value;
+        slot.occupied = true;
+        ++size_;
+        return makeId(index, slot.generation);
+    }
+
+    /**
+     * @brief 预先分配一个槽位并返回id，之后通过set填入元素
+     * @details 用于元素本身在构造时就需要知道自己的id的情况
+     */
+    uint64_t reserve()
+    {
+        return insert(T());
+    }
+
+    /**
+     * @brief 设置已存在id对应的元素，id失效返回false
+     */
+    bool set(uint64_t id, const T& value)
+    {
+        T* p = find(id);
+        if(p == nullptr)
+        {
+            return false;
+        }
+        *p = value;
+        return true;
+    }
+
+    /**
+     * @brief 查找id对应的元素，不存在或id已失效返回nullptr
+     */
+    T* find(uint64_t id)
+    {
+        const uint32_t index = indexOf(id);
+        if(index >= slots_.size())
+        {
+            return nullptr;
+        }
+        Slot& slot = slots_[index];
+        return (slot.occupied && slot.generation == generationOf(id))? &slot.value: nullptr;
+    }
+
+    /**
+     * @brief 删除id对应的元素，槽位代数加1后放回空闲链表
+     * @return 删除的数量，id失效返回0
+     */
+    size_t erase(uint64_t id)
+    {
+        if(find(id) == nullptr)
+        {
+            return 0;
+        }
+        const uint32_t index = indexOf(id);
+        Slot& slot = slots_[index];
+        slot.value = T();
+        slot.occupied = false;
+        ++slot.generation;
+        freeList_.push_back(index);
+        --size_;
+        return 1;
+    }
+
+    /**
+     * @brief 依次访问所有元素 f(id, value)
+     */
+    template<typename Func>
+    void forEach(Func f)
+    {
+        for(uint32_t i = 0; i < slots_.size(); ++i)
+        {
+            if(slots_[i].occupied)
+            {
+                f(makeId(i, slots_[i].generation), slots_[i].value);
+            }
+        }
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+private:
+    struct Slot
+    {
+        Slot()
+        : value(),
+        generation(1),
+        occupied(false)
+        {
+        }
+
+        T value;
+        uint32_t generation;
+        bool occupied;
+    };
+
+    static uint64_t makeId(uint32_t index, uint32_t generation)
+    {
+        return (static_cast<uint64_t>(generation) << 32) | index;
+    }
+    static uint32_t indexOf(uint64_t id) { return static_cast<uint32_t>(id); }
+    static uint32_t generationOf(uint64_t id) { return static_cast<uint32_t>(id >> 32); }
+
+    std::vector<Slot> slots_;
+    /// 空闲槽位下标，后进先出，使刚释放的槽位尽快复用
+    std::vector<uint32_t> freeList_;
+    size_t size_;
+};
+
+} // namespace muduo_study
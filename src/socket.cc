@@ -8,6 +8,18 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+
+#ifndef SO_MAX_PACING_RATE
+#define SO_MAX_PACING_RATE 47
+#endif
+
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+
 
 namespace muduo_study
 {
@@ -52,16 +64,16 @@ bool Socket::getTcpInfoString(char *buf, int len) const
 
 void Socket::bindAddress(const InetAddress& localaddr)
 {
-    int ret = ::bind(sockfd_, localaddr.getSockAddr(), static_cast<socklen_t>(sizeof(struct sockaddr_in)));
+    int ret = ::bind(sockfd_, localaddr.getSockAddr(), localaddr.length());
     if(ret <0)
     {
         LOG_FATAL("%s", "listen socket bind error");
     }
 }
 
-void Socket::listen()
+void Socket::listen(int backlog)
 {
-    int ret = ::listen(sockfd_, SOMAXCONN);
+    int ret = ::listen(sockfd_, backlog);
     if(ret < 0)
     {
         LOG_FATAL("%s", "listen socket listen error");
@@ -70,7 +82,7 @@ void Socket::listen()
 
 int Socket::accept(InetAddress* peeraddr)
 {
-    sockaddr_in addr;
+    sockaddr_storage addr;
     memset(&addr, 0, sizeof(addr));
 
     socklen_t addrlen = static_cast<socklen_t>(sizeof addr);
@@ -78,7 +90,7 @@ int Socket::accept(InetAddress* peeraddr)
     int connfd = ::accept4(sockfd_, (sockaddr*)&addr, &addrlen, SOCK_NONBLOCK| SOCK_CLOEXEC);
     if(connfd >=0)
     {
-        peeraddr->setSockAddr(addr);
+        peeraddr->setSockAddr((sockaddr*)&addr, addrlen);
     }
     return connfd;
 }
@@ -112,6 +124,96 @@ void Socket::setKeepAlive(bool on)
     ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE, &optval, static_cast<socklen_t>(sizeof(optval)));
 }
 
+bool Socket::setZeroCopy(bool on)
+{
+    int optval = on?1:0;
+    return ::setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &optval, static_cast<socklen_t>(sizeof(optval))) == 0;
+}
+
+bool Socket::setMaxPacingRate(uint64_t bytesPerSecond)
+{
+    /// 内核3.13起支持，4.13之前为32位，超出部分截断为~0U表示不限速
+    if(::setsockopt(sockfd_, SOL_SOCKET, SO_MAX_PACING_RATE, &bytesPerSecond, static_cast<socklen_t>(sizeof(bytesPerSecond))) == 0)
+    {
+        return true;
+    }
+    uint32_t rate = bytesPerSecond > 0xffffffffULL? ~0U: static_cast<uint32_t>(bytesPerSecond);
+    return ::setsockopt(sockfd_, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, static_cast<socklen_t>(sizeof(rate))) == 0;
+}
+
+bool Socket::setRecvBuffer(int bytes)
+{
+    return ::setsockopt(sockfd_, SOL_SOCKET, SO_RCVBUF, &bytes, static_cast<socklen_t>(sizeof(bytes))) == 0;
+}
+
+bool Socket::setSendBuffer(int bytes)
+{
+    return ::setsockopt(sockfd_, SOL_SOCKET, SO_SNDBUF, &bytes, static_cast<socklen_t>(sizeof(bytes))) == 0;
+}
+
+bool Socket::setKeepAliveParams(int idleSeconds, int intervalSeconds, int count)
+{
+    bool ok = true;
+    if(idleSeconds > 0)
+    {
+        ok = ::setsockopt(sockfd_, IPPROTO_TCP, TCP_KEEPIDLE, &idleSeconds, static_cast<socklen_t>(sizeof(idleSeconds))) == 0 && ok;
+    }
+    if(intervalSeconds > 0)
+    {
+        ok = ::setsockopt(sockfd_, IPPROTO_TCP, TCP_KEEPINTVL, &intervalSeconds, static_cast<socklen_t>(sizeof(intervalSeconds))) == 0 && ok;
+    }
+    if(count > 0)
+    {
+        ok = ::setsockopt(sockfd_, IPPROTO_TCP, TCP_KEEPCNT, &count, static_cast<socklen_t>(sizeof(count))) == 0 && ok;
+    }
+    return ok;
+}
+
+bool Socket::setDeferAccept(int seconds)
+{
+    return ::setsockopt(sockfd_, IPPROTO_TCP, TCP_DEFER_ACCEPT, &seconds, static_cast<socklen_t>(sizeof(seconds))) == 0;
+}
+
+bool Socket::setFastOpen(int queueLen)
+{
+    return ::setsockopt(sockfd_, IPPROTO_TCP, TCP_FASTOPEN, &queueLen, static_cast<socklen_t>(sizeof(queueLen))) == 0;
+}
+
+bool Socket::setNotSentLowat(int bytes)
+{
+    return ::setsockopt(sockfd_, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &bytes, static_cast<socklen_t>(sizeof(bytes))) == 0;
+}
+
+bool Socket::setQuickAck(bool on)
+{
+    int optval = on?1:0;
+    return ::setsockopt(sockfd_, IPPROTO_TCP, TCP_QUICKACK, &optval, static_cast<socklen_t>(sizeof(optval))) == 0;
+}
+
+bool Socket::setUserTimeout(unsigned int milliseconds)
+{
+    return ::setsockopt(sockfd_, IPPROTO_TCP, TCP_USER_TIMEOUT, &milliseconds, static_cast<socklen_t>(sizeof(milliseconds))) == 0;
+}
+
+bool Socket::setIpv6Only(bool on)
+{
+    int optval = on?1:0;
+    return ::setsockopt(sockfd_, IPPROTO_IPV6, IPV6_V6ONLY, &optval, static_cast<socklen_t>(sizeof(optval))) == 0;
+}
+
+bool Socket::setBusyPoll(int microseconds)
+{
+    return ::setsockopt(sockfd_, SOL_SOCKET, SO_BUSY_POLL, &microseconds, static_cast<socklen_t>(sizeof(microseconds))) == 0;
+}
+
+bool Socket::setLinger(bool on, int seconds)
+{
+    linger lg;
+    lg.l_onoff = on?1:0;
+    lg.l_linger = seconds;
+    return ::setsockopt(sockfd_, SOL_SOCKET, SO_LINGER, &lg, static_cast<socklen_t>(sizeof(lg))) == 0;
+}
+
 } // namespace muduo_study
 
 
@@ -36,9 +36,9 @@ public:
     void bindAddress(const InetAddress& localaddr);
 
     /**
-     * @brief 开始listen，backlog默认设置为128
+     * @brief 开始listen，backlog默认为SOMAXCONN
      */
-    void listen();
+    void listen(int backlog = SOMAXCONN);
 
     /**
      * @brief 接受一个新连接，返回新连接的sockfd，同时更新peeraddr
@@ -70,6 +70,68 @@ public:
      */
     void setKeepAlive(bool on);
 
+    /**
+     * @brief 是否启用SO_ZEROCOPY，内核不支持时返回false
+     */
+    bool setZeroCopy(bool on);
+
+    /**
+     * @brief 设置SO_MAX_PACING_RATE，由内核按bytesPerSecond对发送进行pacing，失败返回false
+     */
+    bool setMaxPacingRate(uint64_t bytesPerSecond);
+
+    /**
+     * @brief 以下选项设置失败时返回false
+     * @brief SO_RCVBUF/SO_SNDBUF，内核实际分配的大小为设置值的两倍
+     */
+    bool setRecvBuffer(int bytes);
+    bool setSendBuffer(int bytes);
+
+    /**
+     * @brief TCP_KEEPIDLE/TCP_KEEPINTVL/TCP_KEEPCNT，单位秒，值为0的参数保持内核默认
+     */
+    bool setKeepAliveParams(int idleSeconds, int intervalSeconds, int count);
+
+    /**
+     * @brief listen socket：TCP_DEFER_ACCEPT，对端在seconds内发来数据后才唤醒accept
+     */
+    bool setDeferAccept(int seconds);
+
+    /**
+     * @brief listen socket：TCP_FASTOPEN，queueLen为尚未完成三次握手的TFO请求队列长度
+     */
+    bool setFastOpen(int queueLen);
+
+    /**
+     * @brief TCP_NOTSENT_LOWAT，发送队列中未发送的数据低于bytes时才报告可写
+     */
+    bool setNotSentLowat(int bytes);
+
+    /**
+     * @brief TCP_QUICKACK，立即发送ACK而不是延迟确认，内核可能在之后自动退出该模式
+     */
+    bool setQuickAck(bool on);
+
+    /**
+     * @brief TCP_USER_TIMEOUT，已发送数据超过milliseconds未被确认则关闭连接
+     */
+    bool setUserTimeout(unsigned int milliseconds);
+
+    /**
+     * @brief SO_BUSY_POLL，阻塞读时在设备队列上忙等的微秒数
+     */
+    bool setBusyPoll(int microseconds);
+
+    /**
+     * @brief IPV6_V6ONLY，为false时IPv6 socket同时接受IPv4连接(对端地址为::ffff:a.b.c.d)，需在bind之前设置
+     */
+    bool setIpv6Only(bool on);
+
+    /**
+     * @brief SO_LINGER，on为true且seconds为0时close直接发送RST并丢弃发送队列中的数据
+     */
+    bool setLinger(bool on, int seconds);
+
 private:
     int sockfd_;
 };
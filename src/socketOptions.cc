@@ -0,0 +1,80 @@
+#include "socketOptions.h"
+#include "socket.h"
+#include "logger.h"
+
+#include <errno.h>
+
+
+namespace muduo_study
+{
+
+void SocketOptions::applyToListener(Socket& socket, sa_family_t family) const
+{
+    if(family == AF_INET6 && !socket.setIpv6Only(ipv6Only))
+    {
+        LOG_ERROR("listenfd %d IPV6_V6ONLY error %d", socket.fd(), errno);
+    }
+    if(recvBuffer > 0 && !socket.setRecvBuffer(recvBuffer))
+    {
+        LOG_ERROR("listenfd %d SO_RCVBUF error %d", socket.fd(), errno);
+    }
+    if(sendBuffer > 0 && !socket.setSendBuffer(sendBuffer))
+    {
+        LOG_ERROR("listenfd %d SO_SNDBUF error %d", socket.fd(), errno);
+    }
+    if(busyPollUs > 0 && !socket.setBusyPoll(busyPollUs))
+    {
+        LOG_ERROR("listenfd %d SO_BUSY_POLL error %d", socket.fd(), errno);
+    }
+    if(family == AF_UNIX)
+    {
+        return ;
+    }
+    if(deferAcceptSeconds > 0 && !socket.setDeferAccept(deferAcceptSeconds))
+    {
+        LOG_ERROR("listenfd %d TCP_DEFER_ACCEPT error %d", socket.fd(), errno);
+    }
+    if(fastOpenQueue > 0 && !socket.setFastOpen(fastOpenQueue))
+    {
+        LOG_ERROR("listenfd %d TCP_FASTOPEN error %d", socket.fd(), errno);
+    }
+}
+
+void SocketOptions::applyToConnection(Socket& socket, bool tcp) const
+{
+    if(busyPollUs > 0 && !socket.setBusyPoll(busyPollUs))
+    {
+        LOG_ERROR("sockfd %d SO_BUSY_POLL error %d", socket.fd(), errno);
+    }
+    if(!tcp)
+    {
+        return ;
+    }
+    if(noDelay)
+    {
+        socket.setTcpNoDelay(true);
+    }
+    if(keepAlive)
+    {
+        socket.setKeepAlive(true);
+        if((keepIdleSeconds > 0 || keepIntervalSeconds > 0 || keepCount > 0)
+           && !socket.setKeepAliveParams(keepIdleSeconds, keepIntervalSeconds, keepCount))
+        {
+            LOG_ERROR("sockfd %d keepalive params error %d", socket.fd(), errno);
+        }
+    }
+    if(notSentLowat > 0 && !socket.setNotSentLowat(notSentLowat))
+    {
+        LOG_ERROR("sockfd %d TCP_NOTSENT_LOWAT error %d", socket.fd(), errno);
+    }
+    if(quickAck && !socket.setQuickAck(true))
+    {
+        LOG_ERROR("sockfd %d TCP_QUICKACK error %d", socket.fd(), errno);
+    }
+    if(userTimeoutMs > 0 && !socket.setUserTimeout(userTimeoutMs))
+    {
+        LOG_ERROR("sockfd %d TCP_USER_TIMEOUT error %d", socket.fd(), errno);
+    }
+}
+
+} // namespace muduo_study
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <sys/socket.h>
+
+
+namespace muduo_study
+{
+
+class Socket;
+
+/**
+ * @brief socket选项配置，由TcpServer设置，Acceptor在listen时、TcpConnection在建立时批量应用
+ * @details 数值为0(或false)的选项不设置，保持内核默认，默认配置下每个连接只多一次setsockopt(SO_KEEPALIVE)
+ * @note 设置失败只记录日志，不影响监听和连接
+ */
+struct SocketOptions
+{
+    SocketOptions()
+    : backlog(SOMAXCONN),
+    deferAcceptSeconds(0),
+    fastOpenQueue(0),
+    recvBuffer(0),
+    sendBuffer(0),
+    noDelay(false),
+    keepAlive(true),
+    keepIdleSeconds(0),
+    keepIntervalSeconds(0),
+    keepCount(0),
+    notSentLowat(0),
+    quickAck(false),
+    userTimeoutMs(0),
+    busyPollUs(0),
+    ipv6Only(false)
+    {
+    }
+
+    /// listen socket：listen的backlog、TCP_DEFER_ACCEPT、TCP_FASTOPEN
+    int backlog;
+    int deferAcceptSeconds;
+    int fastOpenQueue;
+
+    /// SO_RCVBUF/SO_SNDBUF，设置在listen socket上，listen之前设置才能影响窗口扩大因子，accept出的连接继承
+    int recvBuffer;
+    int sendBuffer;
+
+    /// 以下在每个连接建立时设置
+    bool noDelay;
+    bool keepAlive;
+    int keepIdleSeconds;
+    int keepIntervalSeconds;
+    int keepCount;
+    int notSentLowat;
+    bool quickAck;
+    unsigned int userTimeoutMs;
+    /// SO_BUSY_POLL，listen socket和连接都会设置
+    int busyPollUs;
+    /// IPv6监听地址是否只接受IPv6连接，默认false即双栈监听
+    bool ipv6Only;
+
+    /**
+     * @brief 应用于listen socket，在bind之前调用
+     * @param[in] family 监听地址的地址族，AF_UNIX时跳过TCP层的选项，AF_INET6时设置IPV6_V6ONLY
+     */
+    void applyToListener(Socket& socket, sa_family_t family) const;
+
+    /**
+     * @brief 应用于已建立的连接
+     */
+    void applyToConnection(Socket& socket, bool tcp = true) const;
+};
+
+} // namespace muduo_study
@@ -0,0 +1,148 @@
+#include "tcpClient.h"
+#include "eventLoop.h"
+#include "tcpConnection.h"
+#include "logger.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+
+
+namespace
+{
+
+using namespace muduo_study;
+
+/**
+ * @brief TcpClient析构后连接的关闭回调，只在loop中销毁连接，不再访问TcpClient
+ */
+void detachedRemoveConnection(EventLoop* loop, const TcpConnectionPtr& conn)
+{
+    loop->queueInloop(
+        std::bind(&TcpConnection::connectDestroyed, conn)
+    );
+}
+
+InetAddress socketAddress(int sockfd, bool peer)
+{
+    sockaddr_storage addr;
+    memset(&addr, 0, sizeof(addr));
+    socklen_t addrlen = static_cast<socklen_t>(sizeof(addr));
+    int ret = peer? ::getpeername(sockfd, (sockaddr*)&addr, &addrlen)
+                  : ::getsockname(sockfd, (sockaddr*)&addr, &addrlen);
+    if(ret < 0)
+    {
+        LOG_ERROR("sockfd %d %s error %d", sockfd, peer? "getpeername": "getsockname", errno);
+    }
+    return InetAddress((sockaddr*)&addr, addrlen);
+}
+
+} // namespace
+
+
+namespace muduo_study
+{
+
+TcpClient::TcpClient(EventLoop* loop, const InetAddress& serverAddr, const std::string& nameArg)
+    : loop_(loop),
+    connector_(std::make_shared<Connector>(loop, serverAddr)),
+    name_(nameArg),
+    connNamePrefix_(std::make_shared<const std::string>(nameArg + ":" + serverAddr.toIpPort())),
+    connectionCallback_(defaultConnectionCallback),
+    messageCallback_(defaultMessageCallback),
+    retry_(false),
+    connect_(false),
+    nextConnId_(0)
+{
+    connector_->setNewConnectionCallback(
+        std::bind(&TcpClient::newConnection, this, std::placeholders::_1)
+    );
+}
+
+TcpClient::~TcpClient()
+{
+    TcpConnectionPtr conn;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        conn = connection_;
+    }
+
+    if(conn)
+    {
+        /// 连接可能比TcpClient活得更久，关闭回调不能再绑定this
+        CloseCallback cb = std::bind(&detachedRemoveConnection, loop_, std::placeholders::_1);
+        loop_->runInloop(
+            std::bind(&TcpConnection::setCloseCallback, conn, cb)
+        );
+        conn->forceClose();
+    }
+    connector_->stop();
+}
+
+void TcpClient::connect()
+{
+    LOG_INFO("TcpClient::connect %s connecting to %s", name_.c_str(), connector_->serverAddress().toIpPort().c_str());
+    connect_ = true;
+    connector_->start();
+}
+
+void TcpClient::disconnect()
+{
+    connect_ = false;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(connection_)
+    {
+        connection_->shutdown();
+    }
+}
+
+void TcpClient::stop()
+{
+    connect_ = false;
+    connector_->stop();
+}
+
+void TcpClient::newConnection(int sockfd)
+{
+    InetAddress localAddr(socketAddress(sockfd, false));
+    InetAddress peerAddr(socketAddress(sockfd, true));
+
+    char peer[InetAddress::kMaxStringLength];
+    peerAddr.toIpPort(peer, sizeof(peer));
+    const uint64_t connId = ++nextConnId_;
+    LOG_INFO("TcpClient::newConnection %s connid::%lu to %s", name_.c_str(), static_cast<unsigned long>(connId), peer);
+
+    TcpConnectionPtr conn(new TcpConnection(loop_, connId, connNamePrefix_, connId, sockfd, localAddr, peerAddr));
+    conn->setConnectionCallback(connectionCallback_);
+    conn->setMessageCallback(messageCallback_);
+    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->applySocketOptions(socketOptions_);
+    conn->setCloseCallback(
+        std::bind(&TcpClient::removeConnection, this, std::placeholders::_1)
+    );
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connection_ = conn;
+    }
+    conn->connectEstablished();
+}
+
+void TcpClient::removeConnection(const TcpConnectionPtr& conn)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connection_.reset();
+    }
+
+    loop_->queueInloop(
+        std::bind(&TcpConnection::connectDestroyed, conn)
+    );
+
+    if(retry_ && connect_)
+    {
+        LOG_INFO("TcpClient::removeConnection %s reconnecting to %s", name_.c_str(), connector_->serverAddress().toIpPort().c_str());
+        connector_->restart();
+    }
+}
+
+} // namespace muduo_study
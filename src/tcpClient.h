@@ -0,0 +1,106 @@
+#pragma once
+
+#include "nocopyable.h"
+#include "callback.h"
+#include "connector.h"
+#include "socketOptions.h"
+
+#include <string>
+#include <mutex>
+#include <atomic>
+
+
+namespace muduo_study
+{
+
+class EventLoop;
+
+/**
+ * @brief tcp客户端封装类，与TcpServer使用同样的TcpConnection和回调模型
+ * @details 由Connector在loop中发起非阻塞连接，连接建立后创建TcpConnection；
+ * @details loop可以是用户的loop，也可以是EventLoopThreadPool中的某个ioloop，同一个pool可以同时承载server和client的连接
+ * @note 一个TcpClient同一时刻最多持有一个连接；开启retry后连接断开会自动重连
+ */
+class TcpClient: nocopyable
+{
+public:
+    TcpClient(EventLoop* loop, const InetAddress& serverAddr, const std::string& nameArg);
+    ~TcpClient();
+
+    /**
+     * @brief 发起连接，可在任意线程调用
+     */
+    void connect();
+
+    /**
+     * @brief 关闭已建立连接的写端，输出缓冲写完后才真正关闭
+     */
+    void disconnect();
+
+    /**
+     * @brief 停止正在进行的连接和重试，不影响已建立的连接
+     */
+    void stop();
+
+    /**
+     * @brief 获取当前连接，未连接时为空，可在任意线程调用
+     */
+    TcpConnectionPtr connection() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return connection_;
+    }
+
+    EventLoop* getLoop() const { return loop_; }
+    const std::string& name() const { return name_; }
+    bool retry() const { return retry_; }
+
+    /**
+     * @brief 连接断开后自动重连，重连的间隔由Connector按指数退避计算
+     */
+    void enableRetry() { retry_ = true; }
+    void setRetryDelay(double initial, double max) { connector_->setRetryDelay(initial, max); }
+
+    /**
+     * @brief 给与用户设置事件对应的回调函数，需在connect之前设置
+     */
+    void setConnectionCallback(const ConnectionCallback& cb) { connectionCallback_ = cb; }
+    void setMessageCallback(const MessageCallback& cb) { messageCallback_ = cb; }
+    void setWriteCompleteCallback(const WriteCompleteCallback& cb) { writeCompleteCallback_ = cb; }
+
+    /**
+     * @brief 连接建立时应用的socket选项，listen相关的选项不起作用
+     */
+    void setSocketOptions(const SocketOptions& options) { socketOptions_ = options; }
+
+private:
+    /**
+     * @brief Connector连接成功后在loop中调用，创建TcpConnection
+     */
+    void newConnection(int sockfd);
+
+    /**
+     * @brief 连接关闭回调，在loop中执行
+     */
+    void removeConnection(const TcpConnectionPtr& conn);
+
+    EventLoop* loop_;
+    ConnectorPtr connector_;
+    const std::string name_;
+    /// 连接名字的公共前缀 name:serverIpPort
+    std::shared_ptr<const std::string> connNamePrefix_;
+
+    ConnectionCallback connectionCallback_;
+    MessageCallback messageCallback_;
+    WriteCompleteCallback writeCompleteCallback_;
+    SocketOptions socketOptions_;
+
+    std::atomic_bool retry_;
+    std::atomic_bool connect_;
+    /// 只在loop线程访问
+    uint64_t nextConnId_;
+    mutable std::mutex mutex_;
+    TcpConnectionPtr connection_;
+};
+
+} // namespace muduo_study
@@ -9,7 +9,35 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
 
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
+
+
+namespace
+{
+    /// splice模式下每次从socket搬入管道的最大字节数，与管道默认容量一致
+    const size_t kSpliceChunk = 64*1024;
+
+    /// handleWrite中一次writev最多携带的iovec数量
+    const int kMaxOutputIov = 64;
+
+    /// 限速暂停后至少等待积累的令牌数，避免令牌刚补充一点就写一次
+    const size_t kMinThrottleChunk = 4096;
+
+    /// 连接销毁后等待零拷贝完成通知的间隔(秒)与轮数，超时后以RST关闭
+    const double kZeroCopyDrainInterval = 0.02;
+    const int kZeroCopyDrainRounds = 100;
+};
 
 
 namespace muduo_study
@@ -33,46 +61,105 @@ void defaultMessageCallback(const TcpConnectionPtr& conn, Buff* bufer, Timestamp
 
 TcpConnection::TcpConnection(EventLoop* loop, const std::string& name, int sockfd,
                 const InetAddress& localAddr, const InetAddress& peerAddr)
+    : TcpConnection(loop, 0, std::shared_ptr<const std::string>(), 0, sockfd, localAddr, peerAddr)
+{
+    std::call_once(nameOnce_, [&]{ name_ = name; });
+}
+
+TcpConnection::TcpConnection(EventLoop* loop, uint64_t id, const std::shared_ptr<const std::string>& namePrefix, uint64_t seq,
+                int sockfd, const InetAddress& localAddr, const InetAddress& peerAddr)
     : loop_(loop),
-    name_(name),
-    socket_(new Socket(sockfd)),
-    localAddr_(localAddr),
-    peerAddr_(peerAddr),
-    channel_(new Channel(loop, sockfd)),
+    id_(id),
+    namePrefix_(namePrefix),
+    seq_(seq),
     state_(kDisconnected),
     reading_(false),
-    highWaterMark_(64*1024*1024)
+    readPauseReasons_(0),
+    socket_(sockfd),
+    channel_(loop, sockfd),
+    localAddr_(localAddr),
+    peerAddr_(peerAddr),
+    highWaterMark_(64*1024*1024),
+    lowWaterMark_(0),
+    aboveHighWaterMark_(false),
+    segmentBytes_(0),
+    splicePipeBytes_(0),
+    spliceEof_(false),
+    zeroCopyThreshold_(0),
+    zeroCopyNextSeq_(0),
+    inputHighWaterMark_(0),
+    inputLowWaterMark_(0),
+    inputPaused_(false),
+    autoCork_(false),
+    corkFlushQueued_(false),
+    writeSyscalls_(0),
+    corkedSends_(0),
+    throttled_(false),
+    throttledWrites_(0)
 {
-    channel_->setReadCallback(
+    splicePipe_[0] = -1;
+    splicePipe_[1] = -1;
+    channel_.setReadCallback(
         std::bind(&TcpConnection::handleRead, this, std::placeholders::_1)
     );
-    channel_->setWriteCallback(
+    channel_.setWriteCallback(
         std::bind(&TcpConnection::handleWrite, this)
     );
-    channel_->setCloseCallback(
+    channel_.setCloseCallback(
         std::bind(&TcpConnection::handleClose, this)
     );
-    channel_->setErrorCallback(
+    channel_.setErrorCallback(
         std::bind(&TcpConnection::handleError, this)
     );
-    socket_->setKeepAlive(true);
 }
 
 TcpConnection::~TcpConnection()
 {
+    for(OutputSegment& seg: outputSegments_)
+    {
+        if(seg.isFile())
+        {
+            ::close(seg.fd);
+        }
+    }
+    closeSplicePipe();
+}
+
+void TcpConnection::closeSplicePipe()
+{
+    if(splicePipe_[0] >= 0)
+    {
+        ::close(splicePipe_[0]);
+        ::close(splicePipe_[1]);
+        splicePipe_[0] = -1;
+        splicePipe_[1] = -1;
+        splicePipeBytes_ = 0;
+    }
+}
 
+const std::string& TcpConnection::name() const
+{
+    std::call_once(nameOnce_, [this]{
+        if(namePrefix_)
+        {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "#%lu", static_cast<unsigned long>(seq_));
+            name_ = *namePrefix_ + buf;
+        }
+    });
+    return name_;
 }
 
 bool TcpConnection::getTcpInfo(tcp_info* tcpInfo) const 
 {
-    return socket_->getTcpInfo(tcpInfo);
+    return socket_.getTcpInfo(tcpInfo);
 }
 
 std::string TcpConnection::getTcpInfoString() const 
 {
     char buf[1024];
     memset(buf, 0, sizeof(buf));
-    socket_->getTcpInfoString(buf, sizeof(buf));
+    socket_.getTcpInfoString(buf, sizeof(buf));
     return buf;
 }
 
@@ -86,9 +173,8 @@ void TcpConnection::send(const void* message, int len)
         }
         else
         {
-            loop_->runInloop(
-                std::bind(&TcpConnection::sendInLoop, this, message, len)
-            );
+            /// 调用者的内存在任务执行时可能已失效，拷贝一份交给loop
+            send(std::string(static_cast<const char*>(message), len));
         }
     }
 }
@@ -103,15 +189,80 @@ void TcpConnection::send(Buff* message)
             message->retrieveAll();
         }
         else
+        {
+            /// 与loop线程中的语义一致，message被取空；通过swap转移数据，不拷贝
+            Buff owned(0);
+            owned.swap(*message);
+            send(std::move(owned));
+        }
+    }
+}
+
+void TcpConnection::send(std::string&& message)
+{
+    if(state_ == kConnected)
+    {
+        if(loop_->isInLoopThread())
+        {
+            sendInLoop(message.data(), message.size());
+        }
+        else
+        {
+            loop_->runInloop(
+                std::bind(&TcpConnection::sendStringInLoop, shared_from_this(), std::move(message))
+            );
+        }
+    }
+}
+
+void TcpConnection::send(Buff&& message)
+{
+    if(state_ == kConnected)
+    {
+        if(loop_->isInLoopThread())
+        {
+            sendInLoop(message.peek(), message.readableBytes());
+        }
+        else
+        {
+            loop_->runInloop(
+                std::bind(&TcpConnection::sendBuffInLoop, shared_from_this(), std::move(message))
+            );
+        }
+    }
+}
+
+void TcpConnection::send(std::vector<char>&& message)
+{
+    if(state_ == kConnected)
+    {
+        if(loop_->isInLoopThread())
+        {
+            sendInLoop(message.data(), message.size());
+        }
+        else
         {
             loop_->runInloop(
-                std::bind(&TcpConnection::sendInLoop, this,  message->peek(), message->readableBytes())
+                std::bind(&TcpConnection::sendVectorInLoop, shared_from_this(), std::move(message))
             );
         }
     }
 }
 
+void TcpConnection::sendStringInLoop(const std::string& message)
+{
+    sendInLoop(message.data(), message.size());
+}
+
+void TcpConnection::sendBuffInLoop(const Buff& message)
+{
+    sendInLoop(message.peek(), message.readableBytes());
+}
 
+void TcpConnection::sendVectorInLoop(const std::vector<char>& message)
+{
+    sendInLoop(message.data(), message.size());
+}
 
 void TcpConnection::sendInLoop(const void* message, size_t len)
 {
@@ -125,9 +276,10 @@ void TcpConnection::sendInLoop(const void* message, size_t len)
         return ;
     }
     
-    if(!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    if(!autoCork_ && !rateLimited() && !channel_.isWriting() && pendingOutputBytes() == 0)
     {
-        nwrote = write(channel_->fd(), message, len);
+        ++writeSyscalls_;
+        nwrote = write(channel_.fd(), message, len);
         if(nwrote >= 0)
         {
             remaining = len-nwrote;
@@ -153,192 +305,1021 @@ void TcpConnection::sendInLoop(const void* message, size_t len)
 
     if(!faultError && remaining >0)
     {
-        size_t oldlen = outputBuffer_.readableBytes();
-
-        if(oldlen + remaining >= highWaterMark_ && oldlen < highWaterMark_ && highWaterCallback_)
-        {
-            loop_->queueInloop(
-                std::bind(highWaterCallback_, shared_from_this(), oldlen+remaining)
-            );
-        }
-        outputBuffer_.append(static_cast<const char*>(message) + nwrote, remaining);
-        if(!channel_->isWriting())
-        {
-            channel_->enableWriting();
-        }
+        checkHighWaterMark(pendingOutputBytes(), remaining);
+        appendOutput(static_cast<const char*>(message) + nwrote, remaining);
+        scheduleWrite();
     }
 
 }
 
-void TcpConnection::shutdown()
+void TcpConnection::sendFile(int fd, off_t offset, size_t len)
 {
     if(state_ == kConnected)
     {
-        setState(kDisconnecting);
-        loop_->runInloop(
-            std::bind(&TcpConnection::shutdownInLoop, this)
-        );
+        int dupfd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if(dupfd < 0)
+        {
+            LOG_ERROR("%s sendFile dup fd %d error", name().c_str(), fd);
+            return ;
+        }
+        if(loop_->isInLoopThread())
+        {
+            sendFileInLoop(dupfd, offset, len);
+        }
+        else
+        {
+            loop_->runInloop(
+                std::bind(&TcpConnection::sendFileInLoop, shared_from_this(), dupfd, offset, len)
+            );
+        }
     }
 }
 
-void TcpConnection::shutdownInLoop()
+void TcpConnection::sendFileInLoop(int fd, off_t offset, size_t len)
 {
-    if( !channel_->isWriting())
+    ssize_t nwrote = 0;
+    size_t remaining = len;
+    bool faultError = false;
+
+    if(state_ == kDisconnected)
     {
-        socket_->shutdownWrite();
+        LOG_ERROR("%s", "disconnected");
+        ::close(fd);
+        return ;
     }
-}
 
-
-void TcpConnection::forceClose()
-{
-    if(state_ == kConnected || state_ == kDisconnecting)
+    if(!rateLimited() && !channel_.isWriting() && pendingOutputBytes() == 0)
     {
-        loop_->queueInloop(
-            std::bind(&TcpConnection::forceCloseInLoop, shared_from_this())
-        );
+        ++writeSyscalls_;
+        nwrote = ::sendfile(channel_.fd(), fd, &offset, len);
+        if(nwrote >= 0)
+        {
+            remaining = len-nwrote;
+            if(remaining == 0 && writeCompleteCallback_)
+            {
+                loop_->queueInloop(
+                    std::bind(writeCompleteCallback_, shared_from_this())
+                );
+            }
+        }
+        else
+        {
+            nwrote = 0;
+            if(errno != EWOULDBLOCK)
+            {
+                LOG_ERROR("%s sendfile error %d", name().c_str(), errno);
+                faultError = true;
+            }
+        }
     }
-}
 
-void TcpConnection::forceCloseInLoop()
-{
-    if(state_ == kConnected || state_ == kDisconnecting)
+    if(!faultError && remaining >0)
     {
-        handleClose();
+        checkHighWaterMark(pendingOutputBytes(), remaining);
+        outputSegments_.push_back(OutputSegment(fd, offset, remaining, PayloadPtr()));
+        segmentBytes_ += remaining;
+        scheduleWrite();
+    }
+    else
+    {
+        ::close(fd);
     }
 }
 
-
-void TcpConnection::setTcpNoDelay(bool on)
+void TcpConnection::send(const PayloadPtr& message)
 {
-    socket_->setTcpNoDelay(on);
+    if(state_ == kConnected)
+    {
+        if(loop_->isInLoopThread())
+        {
+            sendPayloadInLoop(message);
+        }
+        else
+        {
+            loop_->runInloop(
+                std::bind(&TcpConnection::sendPayloadInLoop, shared_from_this(), message)
+            );
+        }
+    }
 }
 
-const char* TcpConnection::stateToString() const
+void TcpConnection::setZeroCopyThreshold(size_t threshold)
 {
-  switch (state_)
-  {
-    case kDisconnected:
-      return "kDisconnected";
-    case kConnecting:
-      return "kConnecting";
-    case kConnected:
-      return "kConnected";
-    case kDisconnecting:
-      return "kDisconnecting";
-    default:
-      return "unknown state";
-  }
+    if(threshold > 0 && !socket_.setZeroCopy(true))
+    {
+        LOG_ERROR("%s SO_ZEROCOPY not supported", name().c_str());
+        threshold = 0;
+    }
+    zeroCopyThreshold_ = threshold;
 }
 
-
-void TcpConnection::startRead()
+void TcpConnection::sendPayloadInLoop(const PayloadPtr& message)
 {
-    loop_->runInloop(
-        std::bind(&TcpConnection::startReadInLoop, this)
-    );
-}
+    const size_t len = message->size();
+    ssize_t nwrote = 0;
+    bool faultError = false;
 
+    if(state_ == kDisconnected)
+    {
+        LOG_ERROR("%s", "disconnected");
+        return ;
+    }
 
-void TcpConnection::startReadInLoop()
-{
-    if(!reading_ || !channel_->isReading())
+    /// 只有输出队列为空时才能直接交给内核；零拷贝的大数据不参与合并
+    const bool zeroCopy = zeroCopyThreshold_ > 0 && len >= zeroCopyThreshold_;
+    if((!autoCork_ || zeroCopy) && !rateLimited() && !channel_.isWriting() && pendingOutputBytes() == 0)
     {
-        channel_->enableReading();
-        reading_ = true;
+        ++writeSyscalls_;
+        nwrote = zeroCopy? ::send(channel_.fd(), message->data(), len, MSG_ZEROCOPY)
+                         : ::write(channel_.fd(), message->data(), len);
+        if(nwrote >= 0)
+        {
+            if(zeroCopy && nwrote > 0)
+            {
+                ZeroCopyPending pending;
+                pending.seq = zeroCopyNextSeq_++;
+                pending.payload = message;
+                zeroCopyPending_.push_back(std::move(pending));
+                /// 完成通知经EPOLLERR送达，读写都暂停时也要留在epoll中
+                if(!channel_.keepRegistered())
+                {
+                    channel_.setKeepRegistered(true);
+                }
+            }
+            if(static_cast<size_t>(nwrote) == len && writeCompleteCallback_)
+            {
+                loop_->queueInloop(
+                    std::bind(writeCompleteCallback_, shared_from_this())
+                );
+            }
+        }
+        else
+        {
+            /// ENOBUFS(零拷贝超过optmem限制)、EWOULDBLOCK时整体排队，由writev发送
+            nwrote = 0;
+            if(errno == EPIPE || errno == ECONNRESET)
+            {
+                faultError = true;
+            }
+        }
     }
-}
 
-void TcpConnection::stopRead()
-{
-    loop_->runInloop(
-        std::bind(&TcpConnection::stopReadInLoop, this)
-    );
+    const size_t remaining = len - nwrote;
+    if(!faultError && remaining > 0)
+    {
+        checkHighWaterMark(pendingOutputBytes(), remaining);
+        outputSegments_.push_back(OutputSegment(-1, nwrote, remaining, message));
+        segmentBytes_ += remaining;
+        scheduleWrite();
+    }
 }
 
-void TcpConnection::stopReadInLoop()
+void TcpConnection::handleZeroCopyCompletion()
 {
-    if( reading_ || channel_->isReading())
+    char control[128];
+    while(!zeroCopyPending_.empty())
     {
-        channel_->disableReading();
-        reading_ = false;
-    }
-}
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if(::recvmsg(channel_.fd(), &msg, MSG_ERRQUEUE) < 0)
+        {
+            break;
+        }
 
+        for(cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if(!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+               && !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+            {
+                continue;
+            }
+            const sock_extended_err* serr = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cm));
+            if(serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+            {
+                continue;
+            }
 
+            /// [ee_info, ee_data] 区间内的发送已完成，TCP上按序完成
+            const uint32_t hi = serr->ee_data;
+            while(!zeroCopyPending_.empty() && static_cast<int32_t>(hi - zeroCopyPending_.front().seq) >= 0)
+            {
+                zeroCopyPending_.pop_front();
+            }
 
-void TcpConnection::connectEstablished()
-{
-    setState(kConnected);
-    channel_->tie(shared_from_this());
-    channel_->enableReading();
-    conectionCallback_(shared_from_this());
-}
+            /// 内核仍然做了拷贝(如回环地址)，零拷贝只会增加开销，关闭之
+            if(serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+            {
+                zeroCopyThreshold_ = 0;
+            }
+        }
+    }
 
-void TcpConnection::connectDestroyed()
-{
-    if(state_ == kConnected)
+    /// 连接关闭后channel已从epoll中移除，不能再更新
+    if(zeroCopyPending_.empty() && channel_.keepRegistered() && (state_ == kConnected || state_ == kDisconnecting))
     {
-        setState(kDisconnected);
-        channel_->disableAll();
-        conectionCallback_(shared_from_this());
+        channel_.setKeepRegistered(false);
     }
-    channel_->remove();
 }
 
-
-void TcpConnection::handleRead(Timestamp receiveTime)
+void TcpConnection::appendOutput(const char* data, size_t len)
 {
-    int saveErrno = 0;
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &saveErrno);
-    if(n > 0)
-    {
-        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
-    }
-    else if( n== 0)
+    if(outputSegments_.empty())
     {
-        handleClose();
+        outputBuffer_.append(data, len);
     }
     else
     {
-        errno = saveErrno;
-        handleError();
+        outputSegments_.back().trailer.append(data, len);
+        segmentBytes_ += len;
     }
 }
 
-void TcpConnection::handleWrite()
+void TcpConnection::retrieveOutput(size_t n)
 {
-    if(channel_->isWriting())
+    while(n > 0)
     {
-        ssize_t n = ::write(channel_->fd(), outputBuffer_.peek(), outputBuffer_.readableBytes());
-        if(n > 0)
+        const size_t buffered = std::min(n, outputBuffer_.readableBytes());
+        outputBuffer_.retrieve(buffered);
+        n -= buffered;
+        if(n == 0)
         {
-            outputBuffer_.retrieve(n);
-            if(outputBuffer_.readableBytes() == 0)
-            {
-                channel_->disableWriting();
-                if(writeCompleteCallback_)
-                {
-                    loop_->queueInloop(
-                        std::bind(writeCompleteCallback_, shared_from_this())
-                    );
-                }
-                if(state_ == kDisconnecting)
-                {
-                    shutdownInLoop();
-                }
-            }
+            break;
         }
-        else
-        {
 
+        OutputSegment& seg = outputSegments_.front();
+        const size_t written = std::min(n, seg.remaining);
+        seg.offset += written;
+        seg.remaining -= written;
+        segmentBytes_ -= written;
+        n -= written;
+        if(seg.remaining == 0)
+        {
+            popOutputSegment();
+        }
+    }
+}
+
+void TcpConnection::popOutputSegment()
+{
+    OutputSegment& seg = outputSegments_.front();
+    if(seg.isFile())
+    {
+        ::close(seg.fd);
+    }
+    segmentBytes_ -= seg.remaining + seg.trailer.readableBytes();
+    outputBuffer_.swap(seg.trailer);
+    outputSegments_.pop_front();
+}
+
+void TcpConnection::setAutoCork(bool on)
+{
+    autoCork_ = on;
+}
+
+void TcpConnection::scheduleWrite()
+{
+    /// 限速暂停期间由定时器恢复发送
+    if(channel_.isWriting() || throttled_)
+    {
+        return ;
+    }
+
+    if(autoCork_)
+    {
+        ++corkedSends_;
+        if(!corkFlushQueued_)
+        {
+            corkFlushQueued_ = true;
+            loop_->runBeforePoll(
+                std::bind(&TcpConnection::flushCorked, shared_from_this())
+            );
+        }
+    }
+    else
+    {
+        channel_.enableWriting();
+    }
+}
+
+void TcpConnection::flushCorked()
+{
+    corkFlushQueued_ = false;
+    if(!channel_.isWriting() && !throttled_ && state_ != kDisconnected)
+    {
+        writeOutput();
+        if(pendingOutputBytes() > 0 && !channel_.isWriting() && !throttled_)
+        {
+            channel_.enableWriting();
+        }
+    }
+}
+
+void TcpConnection::setSendRateLimit(double bytesPerSecond, double burst)
+{
+    sendBucket_.reset(bytesPerSecond, burst);
+}
+
+void TcpConnection::setSharedSendLimiter(const std::shared_ptr<TokenBucket>& limiter)
+{
+    sharedSendLimiter_ = limiter;
+}
+
+void TcpConnection::applySocketOptions(const SocketOptions& options)
+{
+    options.applyToConnection(socket_, !localAddr_.isUnix());
+}
+
+bool TcpConnection::setPacingRate(uint64_t bytesPerSecond)
+{
+    return socket_.setMaxPacingRate(bytesPerSecond);
+}
+
+size_t TcpConnection::sendBudget()
+{
+    double budget = static_cast<double>(SIZE_MAX);
+    if(!sendBucket_.unlimited())
+    {
+        budget = std::min(budget, sendBucket_.available());
+    }
+    if(sharedSendLimiter_ && !sharedSendLimiter_->unlimited())
+    {
+        budget = std::min(budget, sharedSendLimiter_->available());
+    }
+    if(budget < 1)
+    {
+        return 0;
+    }
+    return budget >= static_cast<double>(SIZE_MAX)? SIZE_MAX: static_cast<size_t>(budget);
+}
+
+void TcpConnection::consumeSendBudget(size_t n)
+{
+    sendBucket_.consume(static_cast<double>(n));
+    if(sharedSendLimiter_)
+    {
+        sharedSendLimiter_->consume(static_cast<double>(n));
+    }
+}
+
+void TcpConnection::throttleWrite()
+{
+    throttled_ = true;
+    ++throttledWrites_;
+    if(channel_.isWriting())
+    {
+        channel_.disableWriting();
+    }
+
+    const double need = static_cast<double>(std::min(pendingOutputBytes(), kMinThrottleChunk));
+    double delay = sendBucket_.waitTime(need);
+    if(sharedSendLimiter_)
+    {
+        delay = std::max(delay, sharedSendLimiter_->waitTime(need));
+    }
+    loop_->runAfter(delay,
+        std::bind(&TcpConnection::resumeThrottledWrite, shared_from_this())
+    );
+}
+
+void TcpConnection::resumeThrottledWrite()
+{
+    throttled_ = false;
+    if(state_ == kDisconnected)
+    {
+        return ;
+    }
+    writeOutput();
+    if(!throttled_ && pendingOutputBytes() > 0 && !channel_.isWriting())
+    {
+        channel_.enableWriting();
+    }
+}
+
+void TcpConnection::setOutputWaterMarks(size_t high, size_t low)
+{
+    highWaterMark_ = high;
+    lowWaterMark_ = std::min(low, high);
+}
+
+void TcpConnection::checkHighWaterMark(size_t oldlen, size_t len)
+{
+    if(oldlen + len >= highWaterMark_ && oldlen < highWaterMark_)
+    {
+        if(highWaterCallback_)
+        {
+            loop_->queueInloop(
+                std::bind(highWaterCallback_, shared_from_this(), oldlen+len)
+            );
+        }
+        if(!aboveHighWaterMark_)
+        {
+            aboveHighWaterMark_ = true;
+            pauseBackpressureSource(backpressureSource_.lock());
+        }
+    }
+}
+
+void TcpConnection::checkLowWaterMark()
+{
+    const size_t pending = pendingOutputBytes();
+    if(aboveHighWaterMark_ && pending <= lowWaterMark_)
+    {
+        aboveHighWaterMark_ = false;
+        resumeBackpressureSource(backpressureSource_.lock());
+        if(lowWaterCallback_)
+        {
+            loop_->queueInloop(
+                std::bind(lowWaterCallback_, shared_from_this(), pending)
+            );
+        }
+    }
+}
+
+void TcpConnection::shutdown()
+{
+    if(state_ == kConnected)
+    {
+        setState(kDisconnecting);
+        loop_->runInloop(
+            std::bind(&TcpConnection::shutdownInLoop, this)
+        );
+    }
+}
+
+void TcpConnection::shutdownInLoop()
+{
+    /// 合并模式下数据可能还在输出队列中等待本轮loop结束时发送，发送完毕后再关闭写端
+    if( !channel_.isWriting() && pendingOutputBytes() == 0)
+    {
+        socket_.shutdownWrite();
+    }
+}
+
+
+void TcpConnection::forceClose()
+{
+    if(state_ == kConnected || state_ == kDisconnecting)
+    {
+        loop_->queueInloop(
+            std::bind(&TcpConnection::forceCloseInLoop, shared_from_this())
+        );
+    }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+    if(state_ == kConnected || state_ == kDisconnecting)
+    {
+        handleClose();
+    }
+}
+
+
+void TcpConnection::setTcpNoDelay(bool on)
+{
+    socket_.setTcpNoDelay(on);
+}
+
+const char* TcpConnection::stateToString() const
+{
+  switch (state_)
+  {
+    case kDisconnected:
+      return "kDisconnected";
+    case kConnecting:
+      return "kConnecting";
+    case kConnected:
+      return "kConnected";
+    case kDisconnecting:
+      return "kDisconnecting";
+    default:
+      return "unknown state";
+  }
+}
+
+
+void TcpConnection::startRead()
+{
+    loop_->runInloop(
+        std::bind(&TcpConnection::startReadInLoop, shared_from_this())
+    );
+}
+
+
+void TcpConnection::startReadInLoop()
+{
+    resumeReadingInLoop(kPausedByUser);
+}
+
+void TcpConnection::stopRead()
+{
+    loop_->runInloop(
+        std::bind(&TcpConnection::stopReadInLoop, shared_from_this())
+    );
+}
+
+void TcpConnection::stopReadInLoop()
+{
+    pauseReadingInLoop(kPausedByUser);
+}
+
+void TcpConnection::pauseReadingInLoop(int reason)
+{
+    readPauseReasons_ |= reason;
+    if(reading_ || channel_.isReading())
+    {
+        channel_.disableReading();
+        reading_ = false;
+    }
+}
+
+void TcpConnection::resumeReadingInLoop(int reason)
+{
+    readPauseReasons_ &= ~reason;
+    if(readPauseReasons_ == 0 && state_ == kConnected && (!reading_ || !channel_.isReading()))
+    {
+        channel_.enableReading();
+        reading_ = true;
+    }
+}
+
+void TcpConnection::setBackpressureSource(const TcpConnectionPtr& src)
+{
+    loop_->runInloop(
+        std::bind(&TcpConnection::setBackpressureSourceInLoop, shared_from_this(), src)
+    );
+}
+
+void TcpConnection::setBackpressureSourceInLoop(const TcpConnectionPtr& src)
+{
+    /// 正处于高水位时，暂停从旧的来源转移到新的来源，否则旧的来源再也等不到低水位的恢复
+    TcpConnectionPtr old = backpressureSource_.lock();
+    if(aboveHighWaterMark_ && old != src)
+    {
+        resumeBackpressureSource(old);
+        pauseBackpressureSource(src);
+    }
+    backpressureSource_ = src;
+}
+
+void TcpConnection::releaseBackpressureSource()
+{
+    /// 本连接关闭后不会再降到低水位线，恢复被暂停的背压来源
+    if(aboveHighWaterMark_)
+    {
+        aboveHighWaterMark_ = false;
+        resumeBackpressureSource(backpressureSource_.lock());
+    }
+    backpressureSource_.reset();
+}
+
+void TcpConnection::pauseBackpressureSource(const TcpConnectionPtr& src)
+{
+    if(src)
+    {
+        src->getLoop()->runInloop(
+            std::bind(&TcpConnection::pauseReadingInLoop, src, static_cast<int>(kPausedByBackpressure))
+        );
+    }
+}
+
+void TcpConnection::resumeBackpressureSource(const TcpConnectionPtr& src)
+{
+    if(src)
+    {
+        src->getLoop()->runInloop(
+            std::bind(&TcpConnection::resumeReadingInLoop, src, static_cast<int>(kPausedByBackpressure))
+        );
+    }
+}
+
+
+
+void TcpConnection::setInputWaterMarks(size_t high, size_t low)
+{
+    inputHighWaterMark_ = high;
+    inputLowWaterMark_ = std::min(low, high);
+}
+
+void TcpConnection::checkInputHighWaterMark()
+{
+    const size_t readable = inputBuffer_.readableBytes();
+    if(!inputPaused_ && readable >= inputHighWaterMark_ && state_ == kConnected)
+    {
+        inputPaused_ = true;
+        pauseReadingInLoop(kPausedByInputWaterMark);
+        if(inputWaterMarkCallback_)
+        {
+            inputWaterMarkCallback_(shared_from_this(), readable, true);
+        }
+        loop_->runBeforePoll(
+            std::bind(&TcpConnection::checkInputLowWaterMark, shared_from_this())
+        );
+    }
+}
+
+void TcpConnection::checkInputLowWaterMark()
+{
+    if(!inputPaused_ || state_ != kConnected)
+    {
+        inputPaused_ = false;
+        return ;
+    }
+
+    const size_t readable = inputBuffer_.readableBytes();
+    if(readable <= inputLowWaterMark_)
+    {
+        inputPaused_ = false;
+        resumeReadingInLoop(kPausedByInputWaterMark);
+        /// 当前处于before-poll阶段，用户回调排入pendingFunctors_，与高水位、写完成回调一致
+        if(inputWaterMarkCallback_)
+        {
+            loop_->queueInloop(
+                std::bind(inputWaterMarkCallback_, shared_from_this(), readable, false)
+            );
+        }
+    }
+    else
+    {
+        loop_->runBeforeNextPoll(
+            std::bind(&TcpConnection::checkInputLowWaterMark, shared_from_this())
+        );
+    }
+}
+
+void TcpConnection::startSplice(const TcpConnectionPtr& dst)
+{
+    if(dst->getLoop() != loop_)
+    {
+        LOG_ERROR("%s splice to %s: connections must share one loop", name().c_str(), dst->name().c_str());
+        return ;
+    }
+    loop_->runInloop(
+        std::bind(&TcpConnection::startSpliceInLoop, shared_from_this(), dst)
+    );
+}
+
+void TcpConnection::startSpliceInLoop(const TcpConnectionPtr& dst)
+{
+    if(splicePipe_[0] < 0 && ::pipe2(splicePipe_, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+        LOG_ERROR("%s splice pipe2 error %d", name().c_str(), errno);
+        return ;
+    }
+    spliceTo_ = dst;
+    dst->spliceFrom_ = shared_from_this();
+
+    /// 切换前已经读入inputBuffer_的数据先转发出去
+    if(inputBuffer_.readableBytes() > 0)
+    {
+        dst->send(&inputBuffer_);
+    }
+}
+
+void TcpConnection::handleSpliceRead()
+{
+    TcpConnectionPtr dst = spliceTo_.lock();
+    if(!dst || dst->disconnected())
+    {
+        handleClose();
+        return ;
+    }
+
+    ssize_t n = ::splice(channel_.fd(), NULL, splicePipe_[1], NULL, kSpliceChunk,
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if(n > 0)
+    {
+        splicePipeBytes_ += n;
+    }
+    else if(n == 0)
+    {
+        spliceEof_ = true;
+        pauseReadingInLoop(kPausedBySplice);
+    }
+    else if(errno != EAGAIN)
+    {
+        handleError();
+        return ;
+    }
+    relaySplice(dst);
+}
+
+void TcpConnection::relaySplice(const TcpConnectionPtr& dst)
+{
+    /// dst的outputBuffer_中还有数据时不能插队，等待dst的handleWrite
+    if(dst->pendingOutputBytes() == 0)
+    {
+        while(splicePipeBytes_ > 0)
+        {
+            ssize_t n = ::splice(splicePipe_[0], NULL, dst->channel_.fd(), NULL, splicePipeBytes_,
+                                 SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if(n > 0)
+            {
+                splicePipeBytes_ -= n;
+            }
+            else
+            {
+                if(n < 0 && errno != EAGAIN)
+                {
+                    /// 目的端出错(如被RST)，关闭目的端，由其handleClose关闭本连接
+                    LOG_ERROR("%s splice to %s error %d", name().c_str(), dst->name().c_str(), errno);
+                    dst->forceClose();
+                    return ;
+                }
+                break;
+            }
+        }
+    }
+
+    if(splicePipeBytes_ > 0)
+    {
+        pauseReadingInLoop(kPausedBySplice);
+        if(!dst->channel_.isWriting())
+        {
+            dst->channel_.enableWriting();
+        }
+    }
+    else if(spliceEof_)
+    {
+        dst->shutdown();
+        /// 本连接读事件已停止，若写事件也没有就会被移出epoll，再也看不到对端关闭；
+        /// 反方向(转发到本连接)也已结束或不存在时，两个方向都已完成，关闭本连接
+        TcpConnectionPtr from = spliceFrom_.lock();
+        if(!from || (from->spliceEof_ && from->splicePipeBytes_ == 0))
+        {
+            forceClose();
+        }
+    }
+    else
+    {
+        resumeReadingInLoop(kPausedBySplice);
+    }
+}
+
+void TcpConnection::connectEstablished()
+{
+    setState(kConnected);
+    channel_.tie(shared_from_this());
+    if(readPauseReasons_ == 0)
+    {
+        channel_.enableReading();
+        reading_ = true;
+    }
+    conectionCallback_(shared_from_this());
+}
+
+void TcpConnection::connectDestroyed()
+{
+    if(state_ == kConnected)
+    {
+        setState(kDisconnected);
+        channel_.disableAll();
+        conectionCallback_(shared_from_this());
+    }
+    releaseBackpressureSource();
+    channel_.remove();
+
+    /// 内核可能还在引用零拷贝payload的内存，等完成通知后才能关闭socket、释放payload
+    if(!zeroCopyPending_.empty())
+    {
+        drainZeroCopyInLoop(kZeroCopyDrainRounds);
+    }
+}
+
+void TcpConnection::drainZeroCopyInLoop(int rounds)
+{
+    handleZeroCopyCompletion();
+    if(zeroCopyPending_.empty())
+    {
+        return ;
+    }
+
+    if(rounds <= 0)
+    {
+        /// close时发送RST，内核丢弃发送队列并解除对payload内存的引用
+        LOG_ERROR("%s %lu zerocopy sends not completed, reset", name().c_str(),
+                  static_cast<unsigned long>(zeroCopyPending_.size()));
+        socket_.setLinger(true, 0);
+        return ;
+    }
+
+    loop_->runAfter(kZeroCopyDrainInterval,
+        std::bind(&TcpConnection::drainZeroCopyInLoop, shared_from_this(), rounds - 1)
+    );
+}
+
+
+void TcpConnection::handleRead(Timestamp receiveTime)
+{
+    if(splicePipe_[0] >= 0)
+    {
+        handleSpliceRead();
+        return ;
+    }
+
+    int saveErrno = 0;
+    ssize_t n = inputBuffer_.readFd(channel_.fd(), &saveErrno);
+    if(n > 0)
+    {
+        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        if(inputHighWaterMark_ > 0)
+        {
+            checkInputHighWaterMark();
+        }
+    }
+    else if( n== 0)
+    {
+        handleClose();
+    }
+    else
+    {
+        errno = saveErrno;
+        handleError();
+    }
+}
+
+void TcpConnection::handleWrite()
+{
+    if(channel_.isWriting())
+    {
+        writeOutput();
+    }
+}
+
+void TcpConnection::writeOutput()
+{
+    /**
+     * @details outputBuffer_和其后连续的payload段(及其trailer)通过一次writev写出；队首为文件段时使用sendfile
+     * @details 只要有一次没有写完，说明socket发送缓冲区已满，等待下一次可写事件
+     */
+    bool blocked = false;
+    bool throttle = false;
+    size_t budget = sendBudget();
+    while(!blocked && pendingOutputBytes() > 0)
+    {
+        if(budget == 0)
+        {
+            throttle = true;
+            break;
+        }
+
+        if(outputBuffer_.readableBytes() == 0 && outputSegments_.front().isFile())
+        {
+            OutputSegment& seg = outputSegments_.front();
+            const size_t want = std::min(seg.remaining, budget);
+            ++writeSyscalls_;
+            ssize_t n = ::sendfile(channel_.fd(), seg.fd, &seg.offset, want);
+            if(n > 0)
+            {
+                seg.remaining -= n;
+                segmentBytes_ -= n;
+                budget -= n;
+                consumeSendBudget(n);
+                blocked = static_cast<size_t>(n) < want;
+            }
+            else
+            {
+                blocked = true;
+                if(n == 0 || errno != EWOULDBLOCK)
+                {
+                    /// 文件被截断或出错，丢弃剩余部分，避免可写事件空转
+                    LOG_ERROR("%s sendfile error %d, drop %lu bytes", name().c_str(), errno, seg.remaining);
+                    segmentBytes_ -= seg.remaining;
+                    seg.remaining = 0;
+                    blocked = false;
+                }
+            }
+
+            if(seg.remaining == 0)
+            {
+                popOutputSegment();
+            }
+        }
+        else
+        {
+            iovec vec[kMaxOutputIov];
+            int iovcnt = 0;
+            size_t total = 0;
+            if(outputBuffer_.readableBytes() > 0)
+            {
+                vec[iovcnt].iov_base = const_cast<char*>(outputBuffer_.peek());
+                vec[iovcnt].iov_len = outputBuffer_.readableBytes();
+                total += vec[iovcnt++].iov_len;
+            }
+            for(size_t i = 0; i < outputSegments_.size() && iovcnt + 2 <= kMaxOutputIov; ++i)
+            {
+                const OutputSegment& seg = outputSegments_[i];
+                if(seg.isFile())
+                {
+                    break;
+                }
+                vec[iovcnt].iov_base = const_cast<char*>(seg.payload->data() + seg.offset);
+                vec[iovcnt].iov_len = seg.remaining;
+                total += vec[iovcnt++].iov_len;
+                if(seg.trailer.readableBytes() == 0)
+                {
+                    continue;
+                }
+                vec[iovcnt].iov_base = const_cast<char*>(seg.trailer.peek());
+                vec[iovcnt].iov_len = seg.trailer.readableBytes();
+                total += vec[iovcnt++].iov_len;
+            }
+
+            /// 限速时截断到令牌允许的字节数
+            if(total > budget)
+            {
+                size_t left = budget;
+                int i = 0;
+                for(; left > vec[i].iov_len; ++i)
+                {
+                    left -= vec[i].iov_len;
+                }
+                vec[i].iov_len = left;
+                iovcnt = i + 1;
+                total = budget;
+            }
+
+            ++writeSyscalls_;
+            ssize_t n = ::writev(channel_.fd(), vec, iovcnt);
+            if(n > 0)
+            {
+                retrieveOutput(n);
+                budget -= n;
+                consumeSendBudget(n);
+                blocked = static_cast<size_t>(n) < total;
+            }
+            else
+            {
+                blocked = true;
+            }
+        }
+    }
+
+    checkLowWaterMark();
+
+    if(throttle)
+    {
+        throttleWrite();
+        return ;
+    }
+
+    if(pendingOutputBytes() == 0)
+    {
+        /// 作为splice的目的端，自身数据写完后继续排空来源连接的管道
+        TcpConnectionPtr src = spliceFrom_.lock();
+        if(src && src->splicePipeBytes_ > 0)
+        {
+            src->relaySplice(shared_from_this());
+            if(src->splicePipeBytes_ > 0)
+            {
+                return ;
+            }
+        }
+
+        if(channel_.isWriting())
+        {
+            channel_.disableWriting();
+        }
+        if(writeCompleteCallback_)
+        {
+            loop_->queueInloop(
+                std::bind(writeCompleteCallback_, shared_from_this())
+            );
+        }
+        if(state_ == kDisconnecting)
+        {
+            shutdownInLoop();
         }
     }
 }
 
 void TcpConnection::handleClose()
 {
-    channel_->disableAll();
+    /// splice的两端会互相关闭，同一轮事件中读事件、关闭事件和forceClose可能先后到达，只处理一次
+    if(state_ == kDisconnected)
+    {
+        return ;
+    }
+    setState(kDisconnected);
+    if(channel_.keepRegistered())
+    {
+        channel_.setKeepRegistered(false);
+    }
+    channel_.disableAll();
+
+    /// 本连接是splice的目的端：拆除转发并关闭数据源。数据源可能正因管道满而暂停读，
+    /// 也可能已经EOF、读写事件都已停止，两种情况下都不会再有事件来关闭它
+    TcpConnectionPtr src = spliceFrom_.lock();
+    if(src)
+    {
+        spliceFrom_.reset();
+        src->spliceTo_.reset();
+        src->forceClose();
+    }
+    closeSplicePipe();
+    releaseBackpressureSource();
 
     TcpConnectionPtr guardThis(shared_from_this());
     conectionCallback_(guardThis);
@@ -347,10 +1328,15 @@ void TcpConnection::handleClose()
 
 void TcpConnection::handleError()
 {
+    if(!zeroCopyPending_.empty())
+    {
+        handleZeroCopyCompletion();
+    }
+
     int optval;
     socklen_t optlen = static_cast<socklen_t>(sizeof optval);
     int err;
-    if (::getsockopt(channel_->fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    if (::getsockopt(channel_.fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
     {
         err = errno;
     }
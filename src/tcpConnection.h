@@ -4,16 +4,23 @@
 #include "buffer.h"
 #include "nocopyable.h"
 #include "inetAddress.h"
+#include "socket.h"
+#include "channel.h"
+#include "tokenBucket.h"
+#include "socketOptions.h"
 
 #include <memory>
 #include <atomic>
+#include <mutex>
+#include <deque>
+#include <string>
+#include <vector>
+#include <sys/types.h>
 
 struct tcp_info;
 namespace muduo_study
 {
 class EventLoop;
-class Socket;
-class Channel;
 class InetAddress;
 class Buff;
 
@@ -34,13 +41,22 @@ public:
     TcpConnection(EventLoop* loop, const std::string& name, int sockfd,
                   const InetAddress& localAddr, const InetAddress& peerAddr);
 
+    /**
+     * @brief 以64位id标识的连接，名字在第一次调用name()时才格式化为 namePrefix#seq
+     * @param[in] namePrefix 同一个server的连接共享，不为每个连接分配字符串
+     * @param[in] seq 名字中的序号，由创建者递增分配；id是SlotMap的打包id，不适合出现在名字中
+     */
+    TcpConnection(EventLoop* loop, uint64_t id, const std::shared_ptr<const std::string>& namePrefix, uint64_t seq,
+                  int sockfd, const InetAddress& localAddr, const InetAddress& peerAddr);
+
     ~TcpConnection();
 
     /**
      * @brief 获取连接的一些状态
      */
     EventLoop* getLoop() const { return loop_; }
-    const std::string& name() const { return name_; }
+    const std::string& name() const;
+    uint64_t id() const { return id_; }
     const InetAddress& localAddress() const { return localAddr_; }
     const InetAddress& peerAddress() const { return peerAddr_; }
     bool connected() const { return state_ == kConnected; }
@@ -56,6 +72,38 @@ public:
     void send(const void* message, int len);
     void send(Buff* message);
 
+    /**
+     * @brief 转移数据所有权的发送
+     * @details 跨线程调用时数据被move进投递给loop的任务，只有一次move，没有额外拷贝，在loop线程中直接写入或追加到输出缓冲区
+     */
+    void send(std::string&& message);
+    void send(Buff&& message);
+    void send(std::vector<char>&& message);
+
+    /**
+     * @brief 向客户端发送文件[offset, offset+len)的内容，使用sendfile零拷贝
+     * @details 文件段与send的内存数据按调用顺序排队，在handleWrite中排空，全部发送完毕后执行WriteCompleteCallback
+     * @note fd在调用时被dup，调用者可以立即关闭自己的fd
+     */
+    void sendFile(int fd, off_t offset, size_t len);
+
+    /**
+     * @brief 发送引用计数的数据，跨线程调用时只增加引用计数，不拷贝
+     * @details 未能立即发送的部分以引用的形式排入输出队列，不拷贝到outputBuffer_，由handleWrite通过writev发送
+     * @details 开启零拷贝且数据不小于阈值时使用MSG_ZEROCOPY发送，payload一直被持有到内核通过错误队列通知发送完成；
+     * @details 有未完成的零拷贝发送时，即使读写都已暂停，fd也留在epoll中以收到EPOLLERR
+     * @note 连接关闭时若还有未完成的零拷贝发送，connectDestroyed之后连接继续持有socket和payload，
+     * @note 定时读取完成通知直到全部完成再关闭socket；超过kZeroCopyDrainRounds轮仍未完成则以SO_LINGER 0关闭，
+     * @note 由RST丢弃内核发送队列，保证payload释放时内核已不再引用其内存
+     */
+    void send(const PayloadPtr& message);
+
+    /**
+     * @brief 设置MSG_ZEROCOPY的阈值，不小于该值的PayloadPtr使用零拷贝发送，0表示关闭
+     * @note 小数据时页面锁定和完成通知的开销大于memcpy，阈值一般取几十KB以上
+     */
+    void setZeroCopyThreshold(size_t threshold);
+
     /**
      * @brief socket关闭写端
      */
@@ -68,8 +116,52 @@ public:
 
     void setTcpNoDelay(bool on);
 
+    /**
+     * @brief 批量设置连接的socket选项，TcpServer在连接建立前调用
+     */
+    void applySocketOptions(const SocketOptions& options);
+
+    /**
+     * @brief 是否开启写合并(auto-cork)，需在连接所属的loop线程或连接建立前调用
+     * @details 开启后，一轮loop中的多次send只追加到输出队列，在本轮loop结束、下一次poll之前统一用一次writev发送
+     * @note 对延迟敏感的连接可以关闭，每次send立即写socket
+     */
+    void setAutoCork(bool on);
+    bool autoCork() const { return autoCork_; }
+
+    /**
+     * @brief 统计：输出路径上的write/writev/sendfile系统调用次数，以及被合并延迟发送的send次数
+     */
+    uint64_t writeSyscalls() const { return writeSyscalls_; }
+    uint64_t corkedSends() const { return corkedSends_; }
+
+    /**
+     * @brief 发送限速，bytesPerSecond为0表示不限速，需在连接所属的loop线程或连接建立前调用
+     * @details 令牌耗尽时暂停写事件，由loop定时器在令牌补充后继续发送，输出队列中的数据不会丢失；
+     * @details 限速期间send不再直接写socket，全部经输出队列发送，可配合输出高水位线对上游施加背压
+     * @param[in] burst 令牌桶容量，即允许的突发字节数
+     */
+    void setSendRateLimit(double bytesPerSecond, double burst);
+
+    /**
+     * @brief 与同一loop上其他连接共享的聚合限速令牌桶，nullptr表示不参与，调用要求同setSendRateLimit
+     * @note limiter只能被同一个loop的连接共享
+     */
+    void setSharedSendLimiter(const std::shared_ptr<TokenBucket>& limiter);
+
+    /**
+     * @brief 由内核通过SO_MAX_PACING_RATE对本连接pacing，内核不支持时返回false，可以退回setSendRateLimit
+     */
+    bool setPacingRate(uint64_t bytesPerSecond);
+
+    /**
+     * @brief 统计：因令牌耗尽暂停发送的次数
+     */
+    uint64_t throttledWrites() const { return throttledWrites_; }
+
     /**
      * @brief 向epoll注册读事件
+     * @note 只清除用户的暂停原因；输入水位、splice管道或背压仍要求暂停时不会恢复读
      */
     void startRead();
 
@@ -80,6 +172,49 @@ public:
 
     bool isReading() const { return reading_; }
 
+    /**
+     * @brief 暂停读的原因，每个原因独立设置和清除，全部清除后才重新注册读事件
+     */
+    enum ReadPauseReason
+    {
+        kPausedByUser = 1 << 0,
+        kPausedByInputWaterMark = 1 << 1,
+        kPausedBySplice = 1 << 2,
+        kPausedByBackpressure = 1 << 3,
+    };
+    int readPauseReasons() const { return readPauseReasons_; }
+
+    /**
+     * @brief 设置输出队列的高/低水位线，需在连接所属的loop线程或连接建立前调用
+     * @details 待发送数据越过high时执行HighWaterMarkCallback；之后降到low及以下时执行LowWaterMarkCallback，生产者据此暂停/恢复
+     */
+    void setOutputWaterMarks(size_t high, size_t low);
+    size_t highWaterMark() const { return highWaterMark_; }
+    size_t lowWaterMark() const { return lowWaterMark_; }
+
+    /**
+     * @brief 设置背压的数据来源：本连接越过输出高水位线时暂停src的读，降到低水位线时恢复，使转发链路的内存有界
+     * @note src可以属于其他loop；传入空指针取消。替换或取消时旧的src若因本连接暂停则恢复，本连接关闭时同样恢复
+     */
+    void setBackpressureSource(const TcpConnectionPtr& src);
+
+    /**
+     * @brief 设置inputBuffer_的高/低水位线，high为0表示不限制
+     * @details MessageCallback返回后inputBuffer_中未处理的数据不小于high时自动stopReadInLoop；
+     * @details 暂停期间每轮loop结束时检查，用户把数据处理到low以下后自动startReadInLoop，从而限制每个连接的内存
+     * @note 一次readFd最多读入可写空间加64KB，inputBuffer_的上限约为high加一次读入的数据量
+     */
+    void setInputWaterMarks(size_t high, size_t low);
+    void setInputWaterMarkCallback(const InputWaterMarkCallback& cb) { inputWaterMarkCallback_ = cb; }
+    bool inputPaused() const { return inputPaused_; }
+
+    /**
+     * @brief 将本连接收到的数据通过splice经管道直接转发到dst，数据不再进入inputBuffer_，也不再调用MessageCallback
+     * @details dst不可写时暂停本连接的读，管道排空后恢复；本连接读到EOF后，待管道排空再shutdown dst，实现半关闭的传递
+     * @note 两个连接必须属于同一个loop；双向转发需要两个连接各自调用一次
+     */
+    void startSplice(const TcpConnectionPtr& dst);
+
     /**
      * @brief 设置对应事件的回调
      * @param[in] cb 用户可以定义，通过TcpServer类方法设定
@@ -88,6 +223,7 @@ public:
     void setMessageCallback(const MessageCallback& cb) { messageCallback_ = cb; }
     void setWriteCompleteCallback(const WriteCompleteCallback& cb) { writeCompleteCallback_ = cb; }
     void setHighWaterMarkCallback(const HighWaterMarkCallback& cb) { highWaterCallback_ = cb; }
+    void setLowWaterMarkCallback(const LowWaterMarkCallback& cb) { lowWaterCallback_ = cb; }
     void setCloseCallback(const CloseCallback& cb) { closeCallback_ = cb; }
 
     /**
@@ -128,22 +264,168 @@ private:
      * @brief 交由对应的loop执行
      */     
     void sendInLoop(const void* message, size_t len);
+    void sendFileInLoop(int fd, off_t offset, size_t len);
+    void sendPayloadInLoop(const PayloadPtr& message);
+    void sendStringInLoop(const std::string& message);
+    void sendBuffInLoop(const Buff& message);
+    void sendVectorInLoop(const std::vector<char>& message);
+
+    /**
+     * @brief 读取socket错误队列中的零拷贝完成通知，释放对应的payload
+     */
+    void handleZeroCopyCompletion();
+
+    /**
+     * @brief 连接销毁后等待零拷贝发送完成，定时器持有本连接的shared_ptr，全部完成或超时后释放
+     */
+    void drainZeroCopyInLoop(int rounds);
     void shutdownInLoop();
     void startReadInLoop();
     void stopReadInLoop();
+
+    /**
+     * @brief 设置/清除一个暂停原因，没有任何原因时才注册读事件
+     */
+    void pauseReadingInLoop(int reason);
+    void resumeReadingInLoop(int reason);
+    void setBackpressureSourceInLoop(const TcpConnectionPtr& src);
+
+    /**
+     * @brief 在src所属的loop中设置/清除其kPausedByBackpressure
+     */
+    static void pauseBackpressureSource(const TcpConnectionPtr& src);
+    void releaseBackpressureSource();
+    static void resumeBackpressureSource(const TcpConnectionPtr& src);
     void forceCloseInLoop();
+    void startSpliceInLoop(const TcpConnectionPtr& dst);
+
+    /**
+     * @brief splice模式下的读事件处理：socket -> 管道 -> dst socket
+     */
+    void handleSpliceRead();
+
+    /**
+     * @brief 尽量把管道中的数据splice到dst，根据管道剩余数据暂停/恢复读，或传递半关闭
+     */
+    void relaySplice(const TcpConnectionPtr& dst);
+
+    /**
+     * @brief 关闭splice管道，管道中未转发的数据被丢弃
+     */
+    void closeSplicePipe();
+
+    /**
+     * @brief 读入数据并执行MessageCallback后检查是否越过输入高水位线
+     */
+    void checkInputHighWaterMark();
+
+    /**
+     * @brief 暂停读期间每轮loop结束时检查，降到低水位线以下时恢复读，否则登记到下一轮
+     */
+    void checkInputLowWaterMark();
 
     void setState(StateE s) { state_ = s;}
     const char* stateToString() const;
 
+    /**
+     * @brief 等待发送的字节数，包括outputBuffer_和排队中的文件段、payload段
+     */
+    size_t pendingOutputBytes() const { return outputBuffer_.readableBytes() + segmentBytes_; }
+
+    /**
+     * @brief 将未能立即发送的数据排到输出队列的末尾
+     */
+    void appendOutput(const char* data, size_t len);
+
+    /**
+     * @brief 数据进入输出队列前检查是否越过高水位线
+     */
+    void checkHighWaterMark(size_t oldlen, size_t len);
+
+    /**
+     * @brief 输出队列被写出后检查是否降到低水位线
+     */
+    void checkLowWaterMark();
+
+    /**
+     * @brief 数据进入输出队列后安排发送：合并模式下登记本轮loop结束时的flush，否则注册写事件
+     */
+    void scheduleWrite();
+
+    /**
+     * @brief 合并模式下本轮loop结束时的flush，没有写完的部分注册写事件
+     */
+    void flushCorked();
+
+    /**
+     * @brief 尽量写出输出队列中的数据，全部写完后执行WriteCompleteCallback以及等待中的shutdown
+     */
+    void writeOutput();
+
+    bool rateLimited() const { return !sendBucket_.unlimited() || sharedSendLimiter_; }
+
+    /**
+     * @brief 本次最多还能发送的字节数，不限速时为SIZE_MAX
+     */
+    size_t sendBudget();
+    void consumeSendBudget(size_t n);
+
+    /**
+     * @brief 令牌耗尽时暂停写事件，并在令牌补充后由定时器恢复发送
+     */
+    void throttleWrite();
+    void resumeThrottledWrite();
+
+    /**
+     * @brief writev成功写出n字节后，依次从outputBuffer_和队首的payload段中移除
+     */
+    void retrieveOutput(size_t n);
+
+    /**
+     * @brief 移除已发送完毕的队首段，其trailer成为新的outputBuffer_
+     */
+    void popOutputSegment();
+
+    /**
+     * @brief 排队中的输出段：fd>=0为文件段，否则为引用payload的内存段
+     * @details 段之后send的内存数据存放在trailer中，段发送完毕后与outputBuffer_交换，保证发送顺序
+     * @details payload段只持有引用，多个连接发送同一payload时不拷贝，最后一个连接发送完毕后释放
+     */
+    struct OutputSegment
+    {
+        OutputSegment(int fdArg, off_t offsetArg, size_t len, const PayloadPtr& payloadArg)
+        : fd(fdArg),
+        offset(offsetArg),
+        remaining(len),
+        payload(payloadArg),
+        trailer(0)
+        {
+        }
+
+        bool isFile() const { return fd >= 0; }
+
+        int fd;
+        off_t offset;
+        size_t remaining;
+        PayloadPtr payload;
+        Buff trailer;
+    };
+
     /// 连接所属的loop
     EventLoop* loop_;
-    const std::string name_;
+    /// 连接id，以及延迟格式化的名字
+    const uint64_t id_;
+    std::shared_ptr<const std::string> namePrefix_;
+    const uint64_t seq_;
+    mutable std::string name_;
+    mutable std::once_flag nameOnce_;
     std::atomic_int state_;
     bool reading_;
-   /// 连接所对应的socket，channel
-    std::unique_ptr<Socket> socket_;
-    std::unique_ptr<Channel> channel_;
+    /// ReadPauseReason的位掩码，只在loop线程访问
+    int readPauseReasons_;
+    /// 连接所对应的socket，channel，直接内嵌在TcpConnection中，与连接对象在同一块内存
+    Socket socket_;
+    Channel channel_;
     /// local和对端的地址
     const InetAddress localAddr_;
     const InetAddress peerAddr_;
@@ -152,11 +434,53 @@ private:
     MessageCallback messageCallback_;
     WriteCompleteCallback writeCompleteCallback_;
     HighWaterMarkCallback highWaterCallback_;
+    LowWaterMarkCallback lowWaterCallback_;
     CloseCallback closeCallback_;
     size_t highWaterMark_;
+    size_t lowWaterMark_;
+    /// 是否越过了高水位线且还没有降到低水位线
+    bool aboveHighWaterMark_;
+    std::weak_ptr<TcpConnection> backpressureSource_;
     /// 输入输出缓冲区
     Buff inputBuffer_;
     Buff outputBuffer_;
+    /// outputBuffer_之后排队的文件段和payload段，以及它们(包括trailer)的总字节数
+    std::deque<OutputSegment> outputSegments_;
+    size_t segmentBytes_;
+    /// splice模式：数据的去向，本连接持有的管道，管道中的字节数，是否已读到EOF
+    std::weak_ptr<TcpConnection> spliceTo_;
+    int splicePipe_[2];
+    size_t splicePipeBytes_;
+    bool spliceEof_;
+    /// 作为splice的目的端时，数据的来源
+    std::weak_ptr<TcpConnection> spliceFrom_;
+
+    /**
+     * @brief 已交给内核、等待完成通知的零拷贝发送，seq为内核为每次成功的MSG_ZEROCOPY发送分配的序号
+     */
+    struct ZeroCopyPending
+    {
+        uint32_t seq;
+        PayloadPtr payload;
+    };
+    size_t zeroCopyThreshold_;
+    uint32_t zeroCopyNextSeq_;
+    std::deque<ZeroCopyPending> zeroCopyPending_;
+    /// 输入缓冲区的高低水位线，以及是否因越过高水位线而暂停读
+    size_t inputHighWaterMark_;
+    size_t inputLowWaterMark_;
+    bool inputPaused_;
+    InputWaterMarkCallback inputWaterMarkCallback_;
+    /// 写合并
+    bool autoCork_;
+    bool corkFlushQueued_;
+    uint64_t writeSyscalls_;
+    uint64_t corkedSends_;
+    /// 发送限速：本连接的令牌桶、loop共享的令牌桶，以及是否在等待令牌补充
+    TokenBucket sendBucket_;
+    std::shared_ptr<TokenBucket> sharedSendLimiter_;
+    bool throttled_;
+    uint64_t throttledWrites_;
 
 };
 
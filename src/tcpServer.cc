@@ -9,6 +9,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <functional>
+#include <mutex>
 
 
 namespace muduo_study
@@ -21,22 +22,44 @@ TcpServer::TcpServer(EventLoop* loop, const InetAddress& listenAddr, const std::
     threadPool_(new EventLoopThreadPool(loop, nameArg)),
     connectionCallback_(defaultConnectionCallback),
     messageCallback_(defaultMessageCallback),
-    nextConnId_(1),
-    started_(0)
+    highWaterMark_(64*1024*1024),
+    lowWaterMark_(0),
+    started_(0),
+    connNamePrefix_(std::make_shared<const std::string>(nameArg + "-" + nameArg)),
+    nextConnSeq_(0),
+    autoCork_(false),
+    mirroredInputCapacity_(0),
+    loopLocal_(false),
+    connectionPoolCapacity_(1024),
+    connSendRate_(0),
+    connSendBurst_(0),
+    loopSendRate_(0),
+    loopSendBurst_(0),
+    draining_(false),
+    drained_(false),
+    drainProgressTimer_(0),
+    drainDeadlineTimer_(0)
 {
     acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this, std::placeholders::_1, std::placeholders::_2));
 }
 
 TcpServer::~TcpServer()
 {
-    for(auto& item: connections_)
+    for(auto& item: loopConnections_)
     {
-        TcpConnectionPtr conn(item.second);
-        item.second.reset(); 
+        item.first->runInloop(
+            std::bind(&TcpServer::destroyLocalConnections, item.second)
+        );
+    }
+
+    connections_.forEach([](uint64_t, TcpConnectionPtr& item)
+    {
+        TcpConnectionPtr conn(item);
+        item.reset(); 
         conn->getLoop()->runInloop(
             std::bind(&TcpConnection::connectDestroyed, conn)
         );
-    }
+    });
 }
 
 void TcpServer::setThreadNum(int numThreads)
@@ -51,6 +74,32 @@ void TcpServer::start()
     {
         threadPool_->start(threadInitCallback_);
 
+        std::vector<EventLoop*> loops = threadPool_->getAllLoops();
+        if(connectionPoolCapacity_ > 0)
+        {
+            for(EventLoop* ioLoop: loops)
+            {
+                connectionPools_[ioLoop] = std::make_shared<FixedBlockPool>(connectionPoolCapacity_);
+            }
+        }
+        if(loopSendRate_ > 0)
+        {
+            for(EventLoop* ioLoop: loops)
+            {
+                loopSendLimiters_[ioLoop] = std::make_shared<TokenBucket>(loopSendRate_, loopSendBurst_);
+            }
+        }
+        if(loopLocal_)
+        {
+            for(size_t i = 0; i < loops.size(); ++i)
+            {
+                LoopConnectionsPtr registry(new LoopConnections);
+                registry->namePrefix = std::make_shared<const std::string>(name_ + "-" + name_ + "/" + std::to_string(i));
+                registry->nextConnSeq = 0;
+                loopConnections_[loops[i]] = registry;
+            }
+        }
+
         loop_->runInloop(
             std::bind(&Acceptor::listen, get_pointer(acceptor_))
         );
@@ -61,25 +110,33 @@ void TcpServer::start()
 void TcpServer::newConnection(int sockfd, const InetAddress& peerAddr)
 {
     EventLoop* ioLoop =  threadPool_->getNextLoop();
-    char buf[64];
-    snprintf(buf, 64, "-%s#%d", name_.c_str(), nextConnId_);
-    ++nextConnId_;
-    std::string connName = name_ + buf;
-
-    LOG_INFO("New connection servername::%s newconnectname::%s from %s", name_.c_str(), connName.c_str(), peerAddr.toIpPort().c_str());
 
-    sockaddr_in localSocketAddr;
+    sockaddr_storage localSocketAddr;
     memset(&localSocketAddr, 0, sizeof(localSocketAddr));
     socklen_t addrlen = static_cast<socklen_t>(sizeof(localSocketAddr));
     ::getsockname(sockfd, (sockaddr*)&localSocketAddr, &addrlen);
-    InetAddress localAddr(localSocketAddr);
+    InetAddress localAddr((sockaddr*)&localSocketAddr, addrlen);
+
+    if(loopLocal_)
+    {
+        ioLoop->runInloop(
+            std::bind(&TcpServer::newConnectionInLoop, this, ioLoop, sockfd, peerAddr, localAddr)
+        );
+        return ;
+    }
 
-    TcpConnectionPtr conn( new TcpConnection(ioLoop, connName, sockfd, localAddr, peerAddr));
+    const uint64_t connId = connections_.reserve();
+    const uint64_t seq = ++nextConnSeq_;
 
-    connections_[connName] = conn;
-    conn->setConnectionCallback(connectionCallback_);
-    conn->setMessageCallback(messageCallback_);
-    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    char peer[InetAddress::kMaxStringLength];
+    peerAddr.toIpPort(peer, sizeof(peer));
+    LOG_INFO("New connection servername::%s connid::%s#%lu from %s", name_.c_str(), connNamePrefix_->c_str(),
+             static_cast<unsigned long>(seq), peer);
+
+    TcpConnectionPtr conn = createConnection(ioLoop, connId, connNamePrefix_, seq, sockfd, localAddr, peerAddr);
+
+    connections_.set(connId, conn);
+    configureConnection(conn);
     conn->setCloseCallback(
         std::bind(&TcpServer::removeConnection, this, std::placeholders::_1)
     );
@@ -89,6 +146,63 @@ void TcpServer::newConnection(int sockfd, const InetAddress& peerAddr)
     );
 }
 
+void TcpServer::newConnectionInLoop(EventLoop* ioLoop, int sockfd, const InetAddress& peerAddr, const InetAddress& localAddr)
+{
+    const LoopConnectionsPtr& registry = loopConnections_[ioLoop];
+    const uint64_t connId = registry->connections.reserve();
+    const uint64_t seq = ++registry->nextConnSeq;
+
+    char peer[InetAddress::kMaxStringLength];
+    peerAddr.toIpPort(peer, sizeof(peer));
+    LOG_INFO("New connection servername::%s connid::%s#%lu from %s", name_.c_str(), registry->namePrefix->c_str(),
+             static_cast<unsigned long>(seq), peer);
+
+    TcpConnectionPtr conn = createConnection(ioLoop, connId, registry->namePrefix, seq, sockfd, localAddr, peerAddr);
+
+    registry->connections.set(connId, conn);
+    configureConnection(conn);
+    conn->setCloseCallback(
+        std::bind(&TcpServer::removeConnectionLocal, registry, get_pointer(acceptor_), std::placeholders::_1)
+    );
+    conn->connectEstablished();
+}
+
+TcpConnectionPtr TcpServer::createConnection(EventLoop* ioLoop, uint64_t connId, const std::shared_ptr<const std::string>& namePrefix, uint64_t seq,
+                                             int sockfd, const InetAddress& localAddr, const InetAddress& peerAddr)
+{
+    auto it = connectionPools_.find(ioLoop);
+    if(it == connectionPools_.end())
+    {
+        return TcpConnectionPtr(new TcpConnection(ioLoop, connId, namePrefix, seq, sockfd, localAddr, peerAddr));
+    }
+    return std::allocate_shared<TcpConnection>(PoolAllocator<TcpConnection>(it->second),
+                                               ioLoop, connId, namePrefix, seq, sockfd, localAddr, peerAddr);
+}
+
+void TcpServer::configureConnection(const TcpConnectionPtr& conn)
+{
+    conn->setConnectionCallback(connectionCallback_);
+    conn->setMessageCallback(messageCallback_);
+    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setHighWaterMarkCallback(highWaterMarkCallback_);
+    conn->setLowWaterMarkCallback(lowWaterMarkCallback_);
+    conn->setOutputWaterMarks(highWaterMark_, lowWaterMark_);
+    conn->setAutoCork(autoCork_);
+    conn->applySocketOptions(socketOptions_);
+    if(connSendRate_ > 0)
+    {
+        conn->setSendRateLimit(connSendRate_, connSendBurst_);
+    }
+    auto limiter = loopSendLimiters_.find(conn->getLoop());
+    if(limiter != loopSendLimiters_.end())
+    {
+        conn->setSharedSendLimiter(limiter->second);
+    }
+    if(mirroredInputCapacity_ > 0 && !conn->inputBuffer()->useMirroredStorage(mirroredInputCapacity_))
+    {
+        LOG_ERROR("%s mirrored input buffer unavailable", conn->name().c_str());
+    }
+}
 
 void TcpServer::removeConnection(const TcpConnectionPtr& conn)
 {
@@ -98,13 +212,260 @@ void TcpServer::removeConnection(const TcpConnectionPtr& conn)
 }
 void TcpServer::removeConnectionInLoop(const TcpConnectionPtr& conn)
 {
-    size_t n = connections_.erase(conn->name());
+    size_t n = connections_.erase(conn->id());
+    if(n > 0)
+    {
+        acceptor_->connectionClosed();
+    }
     EventLoop *ioLoop = conn->getLoop();
     ioLoop->queueInloop(
         std::bind(&TcpConnection::connectDestroyed, conn)
     );
 }    
-} // namespace muduo_study
 
+void TcpServer::removeConnectionLocal(const LoopConnectionsPtr& registry, Acceptor* acceptor, const TcpConnectionPtr& conn)
+{
+    /// acceptor_在threadPool_之后析构，ioloop线程退出前acceptor一定有效
+    if(registry->connections.erase(conn->id()) > 0)
+    {
+        acceptor->connectionClosed();
+    }
+    conn->getLoop()->queueInloop(
+        std::bind(&TcpConnection::connectDestroyed, conn)
+    );
+}
+
+void TcpServer::destroyLocalConnections(const LoopConnectionsPtr& registry)
+{
+    std::vector<TcpConnectionPtr> conns;
+    registry->connections.forEach([&conns](uint64_t, const TcpConnectionPtr& conn)
+    {
+        conns.push_back(conn);
+    });
+    for(const TcpConnectionPtr& conn: conns)
+    {
+        registry->connections.erase(conn->id());
+        conn->connectDestroyed();
+    }
+}
+
+namespace
+{
+
+/**
+ * @brief loop-local模式下合并各个ioloop的连接快照
+ */
+struct ConnectionsMerge
+{
+    std::mutex mutex;
+    std::vector<TcpConnectionPtr> conns;
+    size_t remaining;
+    TcpServer::ConnectionsCallback callback;
+};
+
+void collectConnections(const std::shared_ptr<ConnectionsMerge>& merge, std::vector<TcpConnectionPtr>& local)
+{
+    bool last = false;
+    {
+        std::unique_lock<std::mutex> lock(merge->mutex);
+        merge->conns.insert(merge->conns.end(), local.begin(), local.end());
+        last = --merge->remaining == 0;
+    }
+    if(last)
+    {
+        merge->callback(merge->conns);
+    }
+}
+
+} // namespace
+
+void TcpServer::getConnections(const ConnectionsCallback& cb)
+{
+    if(!loopLocal_ || loopConnections_.empty())
+    {
+        loop_->runInloop([this, cb]
+        {
+            std::vector<TcpConnectionPtr> conns;
+            connections_.forEach([&conns](uint64_t, const TcpConnectionPtr& conn)
+            {
+                conns.push_back(conn);
+            });
+            cb(conns);
+        });
+        return ;
+    }
 
+    std::shared_ptr<ConnectionsMerge> merge(new ConnectionsMerge);
+    merge->remaining = loopConnections_.size();
+    merge->callback = cb;
+    for(auto& item: loopConnections_)
+    {
+        LoopConnectionsPtr registry = item.second;
+        item.first->runInloop([registry, merge]
+        {
+            std::vector<TcpConnectionPtr> local;
+            registry->connections.forEach([&local](uint64_t, const TcpConnectionPtr& conn)
+            {
+                local.push_back(conn);
+            });
+            collectConnections(merge, local);
+        });
+    }
+}
+
+void TcpServer::setSocketOptions(const SocketOptions& options)
+{
+    socketOptions_ = options;
+    acceptor_->setSocketOptions(options);
+}
+
+void TcpServer::setAdmissionControl(size_t maxConnections, double acceptRate, double burst, Acceptor::OverloadAction action)
+{
+    loop_->runInloop(
+        std::bind(&Acceptor::setAdmissionControl, get_pointer(acceptor_), maxConnections, acceptRate, burst, action)
+    );
+}
+
+Acceptor::AdmissionStats TcpServer::admissionStats() const
+{
+    return acceptor_->admissionStats();
+}
+
+void TcpServer::drain(double timeout, const DrainCallback& cb, double progressInterval)
+{
+    loop_->runInloop([this, timeout, cb, progressInterval]
+    {
+        if(draining_)
+        {
+            return ;
+        }
+        drainCallback_ = cb;
+        drainInLoop(timeout, progressInterval);
+    });
+}
+
+void TcpServer::drainInLoop(double timeout, double progressInterval)
+{
+    draining_ = true;
+    LOG_INFO("TcpServer %s drain, timeout %.3fs", name_.c_str(), timeout);
+    acceptor_->stop();
+
+    /// 在连接所属的loop中shutdown，排在connectEstablished之后，尚在建立中的连接也能被关闭
+    getConnections([](const std::vector<TcpConnectionPtr>& conns)
+    {
+        for(const TcpConnectionPtr& conn: conns)
+        {
+            conn->getLoop()->runInloop(
+                std::bind(&TcpConnection::shutdown, conn)
+            );
+        }
+    });
+
+    drainProgressTimer_ = loop_->runEvery(progressInterval, std::bind(&TcpServer::checkDrain, this));
+    drainDeadlineTimer_ = loop_->runAfter(timeout, std::bind(&TcpServer::forceCloseDrain, this));
+}
+
+void TcpServer::checkDrain()
+{
+    getConnections([this](const std::vector<TcpConnectionPtr>& conns)
+    {
+        loop_->runInloop(
+            std::bind(&TcpServer::reportDrain, this, conns.size(), false)
+        );
+    });
+}
+
+void TcpServer::forceCloseDrain()
+{
+    getConnections([this](const std::vector<TcpConnectionPtr>& conns)
+    {
+        for(const TcpConnectionPtr& conn: conns)
+        {
+            LOG_INFO("TcpServer drain deadline, force close %s", conn->name().c_str());
+            conn->forceClose();
+        }
+        loop_->runInloop(
+            std::bind(&TcpServer::reportDrain, this, conns.size(), true)
+        );
+    });
+}
+
+void TcpServer::reportDrain(size_t remaining, bool finished)
+{
+    if(drained_)
+    {
+        return ;
+    }
+    if(remaining == 0)
+    {
+        finished = true;
+    }
+    if(finished)
+    {
+        drained_ = true;
+        loop_->cancel(drainProgressTimer_);
+        loop_->cancel(drainDeadlineTimer_);
+        LOG_INFO("TcpServer %s drained, %lu connections force closed", name_.c_str(), static_cast<unsigned long>(remaining));
+    }
+    if(drainCallback_)
+    {
+        drainCallback_(remaining, finished);
+    }
+}
+
+void TcpServer::broadcast(const PayloadPtr& message, const ConnectionFilter& filter)
+{
+    loop_->runInloop(
+        std::bind(&TcpServer::broadcastInLoop, this, message, filter)
+    );
+}
+
+void TcpServer::broadcastInLoop(const PayloadPtr& message, const ConnectionFilter& filter)
+{
+    /// loop-local模式下连接本来就按loop分好，每个loop在自己的线程中遍历
+    if(!loopConnections_.empty())
+    {
+        for(auto& item: loopConnections_)
+        {
+            LoopConnectionsPtr registry = item.second;
+            item.first->runInloop([registry, message, filter]
+            {
+                std::vector<TcpConnectionPtr> conns;
+                registry->connections.forEach([&conns](uint64_t, const TcpConnectionPtr& conn)
+                {
+                    conns.push_back(conn);
+                });
+                broadcastToConnections(conns, message, filter);
+            });
+        }
+        return ;
+    }
+
+    std::map<EventLoop*, std::vector<TcpConnectionPtr>> connsByLoop;
+    connections_.forEach([&connsByLoop](uint64_t, const TcpConnectionPtr& conn)
+    {
+        connsByLoop[conn->getLoop()].push_back(conn);
+    });
+
+    for(auto& item: connsByLoop)
+    {
+        item.first->runInloop(
+            std::bind(&TcpServer::broadcastToConnections, std::move(item.second), message, filter)
+        );
+    }
+}
+
+void TcpServer::broadcastToConnections(const std::vector<TcpConnectionPtr>& conns,
+                                       const PayloadPtr& message, const ConnectionFilter& filter)
+{
+    for(const TcpConnectionPtr& conn: conns)
+    {
+        if(!filter || filter(conn))
+        {
+            conn->send(message);
+        }
+    }
+}
+
+} // namespace muduo_study
 
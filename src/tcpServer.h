@@ -2,11 +2,15 @@
 
 #include "nocopyable.h"
 #include "callback.h"
+#include "slotMap.h"
+#include "objectPool.h"
+#include "acceptor.h"
 #include <functional>
 #include <memory>
 
 #include <atomic>
 #include <map>
+#include <vector>
 
 
 namespace muduo_study
@@ -24,6 +28,15 @@ class TcpServer: nocopyable
 {
 public:
     using ThreadInitCallback = std::function<void(EventLoop*)>;
+    using ConnectionFilter = std::function<bool(const TcpConnectionPtr&)>;
+    using ConnectionsCallback = std::function<void(const std::vector<TcpConnectionPtr>&)>;
+
+    /**
+     * @brief drain的进度回调，在mainloop中执行
+     * @param remaining 尚未关闭的连接数
+     * @param finished 为true表示drain结束；此时remaining大于0说明这些连接在deadline到达时被强制关闭
+     */
+    using DrainCallback = std::function<void(size_t remaining, bool finished)>;
     enum Option
     {
         kNoReusePort,
@@ -72,6 +85,95 @@ public:
 
     void setWriteCompleteCallback(const WriteCompleteCallback& cb) { writeCompleteCallback_ = cb; }
 
+    void setHighWaterMarkCallback(const HighWaterMarkCallback& cb) { highWaterMarkCallback_ = cb; }
+
+    void setLowWaterMarkCallback(const LowWaterMarkCallback& cb) { lowWaterMarkCallback_ = cb; }
+
+    /**
+     * @brief 新连接默认的输出高/低水位线，默认为64MB/0
+     */
+    void setOutputWaterMarks(size_t high, size_t low) { highWaterMark_ = high; lowWaterMark_ = low; }
+
+    /**
+     * @brief 新连接是否开启写合并(auto-cork)，默认关闭；单个连接可以通过TcpConnection::setAutoCork开启
+     */
+    void setAutoCork(bool on) { autoCork_ = on; }
+
+    /**
+     * @brief 新连接的inputBuffer_使用capacity大小的镜像环形存储，0表示使用默认的vector存储
+     * @note 每个镜像缓冲区占一个memfd对象和2个内存映射(VMA)，进程的映射数受vm.max_map_count(默认65530)限制，
+     * @note 加上程序自身的映射，同时开启的连接最多约3万个；超出后mmap失败，新连接退回vector存储。需要更多连接时调大vm.max_map_count
+     */
+    void setMirroredInputBuffer(size_t capacity) { mirroredInputCapacity_ = capacity; }
+
+    /**
+     * @brief 每个ioloop的连接对象池最多缓存的空闲块数量，0表示不使用对象池，需在start之前设置
+     * @details 连接对象、内嵌的Socket/Channel以及shared_ptr控制块通过allocate_shared一次分配在同一块内存中，
+     * @details 连接销毁后该内存块留在所属loop的池中供下一个连接复用
+     */
+    void setConnectionPoolCapacity(size_t maxCached) { connectionPoolCapacity_ = maxCached; }
+
+    /**
+     * @brief 准入控制：同时存在的连接数上限与accept速率的令牌桶，可在任意线程调用
+     * @param[in] maxConnections 连接数上限，0表示不限制
+     * @param[in] acceptRate 每秒accept的连接数，0表示不限制；burst为允许的突发数
+     * @param[in] action 超限时暂停accept或RST关闭新连接
+     */
+    void setAdmissionControl(size_t maxConnections, double acceptRate = 0, double burst = 0,
+                             Acceptor::OverloadAction action = Acceptor::kStopReading);
+    Acceptor::AdmissionStats admissionStats() const;
+
+    /**
+     * @brief socket选项配置，需在start之前设置
+     * @details listen相关的选项在listen时应用于监听socket，其余的在每个连接建立时应用
+     */
+    void setSocketOptions(const SocketOptions& options);
+
+    /**
+     * @brief 每个新连接默认的发送限速，0表示不限速，需在start之前设置
+     */
+    void setConnectionSendRateLimit(double bytesPerSecond, double burst)
+    {
+        connSendRate_ = bytesPerSecond;
+        connSendBurst_ = burst;
+    }
+
+    /**
+     * @brief 每个ioloop上所有连接共享的聚合发送限速，0表示不限速，需在start之前设置
+     */
+    void setLoopSendRateLimit(double bytesPerSecond, double burst)
+    {
+        loopSendRate_ = bytesPerSecond;
+        loopSendBurst_ = burst;
+    }
+
+    /**
+     * @brief 向所有连接(或filter返回true的连接)发送同一份payload，可在任意线程调用
+     * @details 在mainloop中按连接所属的loop分组，每个loop只投递一个任务，由该loop在自己的线程中依次发送
+     * @details filter在连接所属的loop线程中执行，payload以引用的形式进入各连接的输出队列，不拷贝
+     */
+    void broadcast(const PayloadPtr& message, const ConnectionFilter& filter = ConnectionFilter());
+
+    /**
+     * @brief 连接由所属的ioloop各自登记，需在start之前设置
+     * @details 新连接在ioloop中创建并登记，连接关闭时只在ioloop中注销，不再经过mainloop，每次关闭少两次跨线程唤醒
+     * @note 该模式下TcpConnection::id()只在所属loop内唯一，名字中带有loop的序号
+     */
+    void setLoopLocalConnections(bool on) { loopLocal_ = on; }
+
+    /**
+     * @brief 获取当前所有连接的快照，可在任意线程调用
+     * @details 默认模式下在mainloop中收集；loop-local模式下向每个ioloop投递收集任务，最后一个完成的loop合并后执行cb
+     */
+    void getConnections(const ConnectionsCallback& cb);
+
+    /**
+     * @brief 优雅下线，可在任意线程调用，只有第一次调用生效
+     * @details 停止accept新连接；每个连接在所属loop中shutdown，输出队列写完后才真正关闭写端，等待对端关闭。
+     * @details 每隔progressInterval秒以剩余连接数回调一次cb；timeout秒后仍未关闭的连接被强制关闭
+     */
+    void drain(double timeout, const DrainCallback& cb, double progressInterval = 0.1);
+
 private:
 
     /**
@@ -88,8 +190,55 @@ private:
     void removeConnection(const TcpConnectionPtr& conn);
     void removeConnectionInLoop(const TcpConnectionPtr& conn);
 
-  
-    using ConnectionMap = std::map<std::string, TcpConnectionPtr>;
+    /**
+     * @brief 为新连接设置用户回调和各项参数
+     */
+    void configureConnection(const TcpConnectionPtr& conn);
+
+    /**
+     * @brief 创建连接对象，ioLoop有对象池时从池中分配
+     */
+    TcpConnectionPtr createConnection(EventLoop* ioLoop, uint64_t connId, const std::shared_ptr<const std::string>& namePrefix, uint64_t seq,
+                                      int sockfd, const InetAddress& localAddr, const InetAddress& peerAddr);
+
+    /// 以连接id索引，accept/close时不需要格式化名字和字符串比较
+    using ConnectionMap = SlotMap<TcpConnectionPtr>;
+
+    /**
+     * @brief ioloop自己登记的连接
+     * @note 只在所属的ioloop线程访问；以shared_ptr持有，使关闭回调和销毁任务不依赖TcpServer的生命周期
+     */
+    struct LoopConnections
+    {
+        ConnectionMap connections;
+        std::shared_ptr<const std::string> namePrefix;
+        /// 连接名字中的序号
+        uint64_t nextConnSeq;
+    };
+    using LoopConnectionsPtr = std::shared_ptr<LoopConnections>;
+
+    /**
+     * @brief loop-local模式下在ioloop中创建、登记并建立连接
+     */
+    void newConnectionInLoop(EventLoop* ioLoop, int sockfd, const InetAddress& peerAddr, const InetAddress& localAddr);
+    static void removeConnectionLocal(const LoopConnectionsPtr& registry, Acceptor* acceptor, const TcpConnectionPtr& conn);
+    static void destroyLocalConnections(const LoopConnectionsPtr& registry);
+
+    /**
+     * @brief drain在mainloop中的各个阶段
+     */
+    void drainInLoop(double timeout, double progressInterval);
+    void checkDrain();
+    void forceCloseDrain();
+    void reportDrain(size_t remaining, bool finished);
+
+    /**
+     * @brief broadcast在mainloop中的分组，以及在各个ioloop中的发送
+     */
+    void broadcastInLoop(const PayloadPtr& message, const ConnectionFilter& filter);
+    static void broadcastToConnections(const std::vector<TcpConnectionPtr>& conns,
+                                       const PayloadPtr& message, const ConnectionFilter& filter);
+
     /// 用户创建的EventLoop, MainLoop;
     EventLoop* loop_;
     const std::string ipPort_;
@@ -100,13 +249,41 @@ private:
     ConnectionCallback connectionCallback_;
     MessageCallback messageCallback_;
     WriteCompleteCallback writeCompleteCallback_;
+    HighWaterMarkCallback highWaterMarkCallback_;
+    LowWaterMarkCallback lowWaterMarkCallback_;
+    size_t highWaterMark_;
+    size_t lowWaterMark_;
     ThreadInitCallback threadInitCallback_;
 
     std::atomic_int started_;
 
-    int nextConnId_;
+    /// 连接名字的公共前缀，所有连接共享；名字中的序号，只在mainloop中递增
+    std::shared_ptr<const std::string> connNamePrefix_;
+    uint64_t nextConnSeq_;
+    bool autoCork_;
+    size_t mirroredInputCapacity_;
     /// 维护所以建立连接的TcpConnection
     ConnectionMap connections_;
+    /// loop-local模式下每个ioloop登记的连接，start后只读
+    bool loopLocal_;
+    std::map<EventLoop*, LoopConnectionsPtr> loopConnections_;
+    /// 每个ioloop的连接对象池，start后只读
+    size_t connectionPoolCapacity_;
+    std::map<EventLoop*, FixedBlockPoolPtr> connectionPools_;
+    /// 发送限速，loopSendLimiters_在start后只读，令牌桶只在所属ioloop中访问
+    SocketOptions socketOptions_;
+    double connSendRate_;
+    double connSendBurst_;
+    double loopSendRate_;
+    double loopSendBurst_;
+    std::map<EventLoop*, std::shared_ptr<TokenBucket>> loopSendLimiters_;
+
+    /// drain的状态，只在mainloop中访问
+    bool draining_;
+    bool drained_;
+    DrainCallback drainCallback_;
+    TimerId drainProgressTimer_;
+    TimerId drainDeadlineTimer_;
 };
 
 } // namespace muduo_study
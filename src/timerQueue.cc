@@ -0,0 +1,176 @@
+#include "timerQueue.h"
+#include "eventLoop.h"
+#include "logger.h"
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <algorithm>
+
+
+namespace
+{
+
+using namespace muduo_study;
+
+int createTimerfd()
+{
+    int timerfd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(timerfd < 0)
+    {
+        LOG_FATAL("%s", "Failed in timerfd_create");
+    }
+    return timerfd;
+}
+
+} // namespace
+
+
+namespace muduo_study
+{
+
+TimerQueue::TimerQueue(EventLoop* loop)
+    : loop_(loop),
+    timerfd_(createTimerfd()),
+    timerfdChannel_(loop, timerfd_),
+    nextId_(1)
+{
+    timerfdChannel_.setReadCallback(std::bind(&TimerQueue::handleRead, this));
+    timerfdChannel_.enableReading();
+}
+
+TimerQueue::~TimerQueue()
+{
+    timerfdChannel_.disableAll();
+    timerfdChannel_.remove();
+    ::close(timerfd_);
+}
+
+int64_t TimerQueue::now()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+TimerId TimerQueue::addTimer(TimerCallback cb, int64_t when, int64_t interval)
+{
+    const TimerId timerId = nextId_++;
+    if(loop_->isInLoopThread())
+    {
+        addTimerInLoop(timerId, cb, when, interval);
+    }
+    else
+    {
+        /// std::function要求可拷贝，cb以shared_ptr转移到loop线程
+        std::shared_ptr<TimerCallback> holder = std::make_shared<TimerCallback>(std::move(cb));
+        loop_->queueInloop([this, timerId, holder, when, interval]
+        {
+            addTimerInLoop(timerId, *holder, when, interval);
+        });
+    }
+    return timerId;
+}
+
+void TimerQueue::cancel(TimerId timerId)
+{
+    loop_->runInloop(
+        std::bind(&TimerQueue::cancelInLoop, this, timerId)
+    );
+}
+
+void TimerQueue::addTimerInLoop(TimerId timerId, TimerCallback& cb, int64_t when, int64_t interval)
+{
+    const bool earliestChanged = entries_.empty() || when < entries_.begin()->first;
+    Timer& timer = timers_[timerId];
+    timer.callback = std::move(cb);
+    timer.expiration = when;
+    timer.interval = interval;
+    entries_.insert(Entry(when, timerId));
+    if(earliestChanged)
+    {
+        resetTimerfd();
+    }
+}
+
+void TimerQueue::cancelInLoop(TimerId timerId)
+{
+    auto it = timers_.find(timerId);
+    if(it == timers_.end())
+    {
+        return ;
+    }
+    entries_.erase(Entry(it->second.expiration, timerId));
+    timers_.erase(it);
+}
+
+void TimerQueue::handleRead()
+{
+    uint64_t howmany;
+    ssize_t n = ::read(timerfd_, &howmany, sizeof(howmany));
+    if(n != sizeof(howmany) && errno != EAGAIN)
+    {
+        LOG_ERROR("TimerQueue::handleRead() reads %ld bytes", static_cast<long>(n));
+    }
+
+    const int64_t current = now();
+    expired_.clear();
+    auto end = entries_.lower_bound(Entry(current + 1, 0));
+    expired_.assign(entries_.begin(), end);
+    entries_.erase(entries_.begin(), end);
+
+    for(const Entry& entry: expired_)
+    {
+        /// 前面的回调可能已经取消了这个定时器
+        auto it = timers_.find(entry.second);
+        if(it == timers_.end())
+        {
+            continue;
+        }
+        TimerCallback cb = it->second.callback;
+        cb();
+
+        /// 回调中可能取消了自己，也可能添加了新的定时器使rehash，需要重新查找
+        it = timers_.find(entry.second);
+        if(it == timers_.end())
+        {
+            continue;
+        }
+        if(it->second.interval > 0)
+        {
+            it->second.expiration = std::max(current, it->second.expiration) + it->second.interval;
+            entries_.insert(Entry(it->second.expiration, entry.second));
+        }
+        else
+        {
+            timers_.erase(it);
+        }
+    }
+
+    resetTimerfd();
+}
+
+void TimerQueue::resetTimerfd()
+{
+    struct itimerspec newValue;
+    memset(&newValue, 0, sizeof(newValue));
+    if(!entries_.empty())
+    {
+        /// it_value全为0会解除timerfd，已到期的定时器至少等待1微秒
+        int64_t delay = entries_.begin()->first - now();
+        if(delay < 1)
+        {
+            delay = 1;
+        }
+        newValue.it_value.tv_sec = static_cast<time_t>(delay / 1000000);
+        newValue.it_value.tv_nsec = static_cast<long>((delay % 1000000) * 1000);
+    }
+    if(::timerfd_settime(timerfd_, 0, &newValue, NULL) < 0)
+    {
+        LOG_ERROR("%s", "timerfd_settime error");
+    }
+}
+
+} // namespace muduo_study
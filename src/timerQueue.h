@@ -0,0 +1,83 @@
+#pragma once
+
+#include "nocopyable.h"
+#include "callback.h"
+#include "channel.h"
+
+#include <atomic>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+namespace muduo_study
+{
+
+class EventLoop;
+
+/**
+ * @brief 基于timerfd的定时器队列，每个EventLoop一个
+ * @details 所有定时器按到期时间排序，timerfd只设置为最早的到期时间，到期后timerfd可读，在loop线程中执行到期的回调。
+ * @details 时间使用CLOCK_MONOTONIC，单位微秒，不受系统时间调整影响
+ */
+class TimerQueue: nocopyable
+{
+public:
+    explicit TimerQueue(EventLoop* loop);
+    ~TimerQueue();
+
+    /**
+     * @brief 添加定时器，可在任意线程调用
+     * @param[in] when 到期时间，monotonic微秒
+     * @param[in] interval 大于0时为周期定时器，单位微秒
+     */
+    TimerId addTimer(TimerCallback cb, int64_t when, int64_t interval);
+
+    /**
+     * @brief 取消定时器，可在任意线程调用；定时器已到期或已取消则什么也不做
+     * @note 可以在定时器自己的回调中取消周期定时器
+     */
+    void cancel(TimerId timerId);
+
+    /**
+     * @brief 当前的monotonic时间，单位微秒
+     */
+    static int64_t now();
+
+private:
+    struct Timer
+    {
+        TimerCallback callback;
+        int64_t expiration;
+        int64_t interval;
+    };
+
+    /// (到期时间, 定时器id)，id单调递增，保证同一到期时间的定时器按添加顺序执行
+    using Entry = std::pair<int64_t, TimerId>;
+
+    void addTimerInLoop(TimerId timerId, TimerCallback& cb, int64_t when, int64_t interval);
+    void cancelInLoop(TimerId timerId);
+
+    /**
+     * @brief timerfd可读时的回调，执行所有到期的定时器，周期定时器重新加入队列
+     */
+    void handleRead();
+
+    /**
+     * @brief 把timerfd设置为最早的到期时间
+     */
+    void resetTimerfd();
+
+    EventLoop* loop_;
+    const int timerfd_;
+    Channel timerfdChannel_;
+    std::atomic<TimerId> nextId_;
+    /// 按到期时间排序的定时器
+    std::set<Entry> entries_;
+    std::unordered_map<TimerId, Timer> timers_;
+    /// 本次handleRead中到期的定时器
+    std::vector<Entry> expired_;
+};
+
+} // namespace muduo_study
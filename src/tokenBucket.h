@@ -0,0 +1,106 @@
+#pragma once
+
+#include "timerQueue.h"
+
+#include <algorithm>
+#include <stdint.h>
+
+
+namespace muduo_study
+{
+
+/**
+ * @brief 令牌桶
+ * @details 令牌以rate个/秒的速度持续补充，最多积累burst个；每次消耗前按经过的monotonic时间补充令牌，不需要定时器。
+ * @note 非线程安全，由使用者保证在同一个线程中访问
+ */
+class TokenBucket
+{
+public:
+    /**
+     * @param[in] rate 每秒补充的令牌数，0表示不限速
+     * @param[in] burst 桶的容量，初始为满
+     */
+    explicit TokenBucket(double rate = 0, double burst = 0)
+    {
+        reset(rate, burst);
+    }
+
+    void reset(double rate, double burst)
+    {
+        rate_ = rate;
+        burst_ = std::max(burst, 1.0);
+        tokens_ = burst_;
+        lastRefill_ = TimerQueue::now();
+    }
+
+    bool unlimited() const { return rate_ <= 0; }
+    double rate() const { return rate_; }
+
+    /**
+     * @brief 当前可用的令牌数
+     */
+    double available()
+    {
+        refill();
+        return unlimited()? burst_: tokens_;
+    }
+
+    /**
+     * @brief 令牌足够时消耗n个并返回true，否则不消耗返回false
+     */
+    bool tryConsume(double n = 1)
+    {
+        if(unlimited())
+        {
+            return true;
+        }
+        refill();
+        if(tokens_ < n)
+        {
+            return false;
+        }
+        tokens_ -= n;
+        return true;
+    }
+
+    /**
+     * @brief 直接消耗n个令牌，允许欠账，欠下的令牌由之后的补充偿还
+     */
+    void consume(double n)
+    {
+        if(!unlimited())
+        {
+            refill();
+            tokens_ -= n;
+        }
+    }
+
+    /**
+     * @brief 积累到n个令牌还需要等待的秒数
+     */
+    double waitTime(double n = 1)
+    {
+        if(unlimited())
+        {
+            return 0;
+        }
+        refill();
+        return tokens_ >= n? 0: (n - tokens_) / rate_;
+    }
+
+private:
+    void refill()
+    {
+        const int64_t current = TimerQueue::now();
+        tokens_ = std::min(burst_, tokens_ + static_cast<double>(current - lastRefill_) * rate_ / 1000000);
+        lastRefill_ = current;
+    }
+
+    double rate_;
+    double burst_;
+    double tokens_;
+    int64_t lastRefill_;
+};
+
+} // namespace muduo_study
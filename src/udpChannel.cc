@@ -0,0 +1,424 @@
+#include "udpChannel.h"
+#include "eventLoop.h"
+#include "logger.h"
+
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <netinet/udp.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+
+namespace
+{
+
+using namespace muduo_study;
+
+/// 一次GSO发送的UDP载荷上限，65535减去IPv4与UDP头部
+const size_t kMaxGsoBytes = 65507;
+const size_t kGroControlSize = CMSG_SPACE(sizeof(int));
+
+/**
+ * @brief 从recvmmsg返回的控制消息中取出GRO的分段大小，没有合并时返回0
+ */
+size_t groSegmentSize(msghdr* hdr)
+{
+    for(cmsghdr* cmsg = CMSG_FIRSTHDR(hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(hdr, cmsg))
+    {
+        if(cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+        {
+            int segment = 0;
+            ::memcpy(&segment, CMSG_DATA(cmsg), sizeof(segment));
+            return segment > 0? static_cast<size_t>(segment): 0;
+        }
+    }
+    return 0;
+}
+
+int createDatagramSocket(sa_family_t family)
+{
+    const int protocol = (family == AF_UNIX)? 0: IPPROTO_UDP;
+    int sockfd = ::socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, protocol);
+    if(sockfd < 0)
+    {
+        LOG_FATAL("%s:%s:%d datagram socket create err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return sockfd;
+}
+
+} // namespace
+
+
+namespace muduo_study
+{
+
+const int UdpChannel::kMaxReadRounds;
+const size_t UdpChannel::kMaxGroSize;
+const size_t UdpChannel::kMaxSegments;
+
+UdpChannel::UdpChannel(EventLoop* loop, const InetAddress& bindAddr, bool reusePort,
+                       size_t batchSize, size_t maxDatagramSize)
+    : loop_(loop),
+    socket_(createDatagramSocket(bindAddr.family())),
+    channel_(loop, socket_.fd()),
+    localAddr_(bindAddr),
+    batchSize_(batchSize > 0? batchSize: 1),
+    maxDatagramSize_(maxDatagramSize > 0? maxDatagramSize: 1),
+    recvArena_(batchSize_ * maxDatagramSize_),
+    recvIov_(batchSize_),
+    recvAddrs_(batchSize_),
+    recvHdrs_(batchSize_),
+    messages_(batchSize_),
+    groEnabled_(false),
+    gsoSupported_(true),
+    sendArena_(batchSize_ * maxDatagramSize_),
+    sendIov_(batchSize_),
+    sendAddrs_(batchSize_),
+    sendHdrs_(batchSize_),
+    sendCount_(0),
+    flushQueued_(false),
+    receivedDatagrams_(0),
+    sentDatagrams_(0),
+    droppedDatagrams_(0),
+    recvSyscalls_(0),
+    sendSyscalls_(0)
+{
+    if(!bindAddr.isUnix())
+    {
+        socket_.setReuseAddr(true);
+        socket_.setReusePort(reusePort);
+    }
+    if(bindAddr.isIpv6())
+    {
+        socket_.setIpv6Only(false);
+    }
+    socket_.bindAddress(bindAddr);
+
+    /// 探测一次内核是否支持UDP_SEGMENT；之后sendmsg返回EINVAL只说明该次的参数不被接受
+    int gsoSize = 0;
+    socklen_t optlen = static_cast<socklen_t>(sizeof(gsoSize));
+    gsoSupported_ = !bindAddr.isUnix() && ::getsockopt(socket_.fd(), SOL_UDP, UDP_SEGMENT, &gsoSize, &optlen) == 0;
+
+    sockaddr_storage local;
+    memset(&local, 0, sizeof(local));
+    socklen_t addrlen = static_cast<socklen_t>(sizeof(local));
+    if(::getsockname(socket_.fd(), (sockaddr*)&local, &addrlen) == 0)
+    {
+        localAddr_.setSockAddr((sockaddr*)&local, addrlen);
+    }
+
+    /// iovec和地址与槽位一一对应，只需在每次调用前重置长度
+    memset(recvHdrs_.data(), 0, recvHdrs_.size() * sizeof(mmsghdr));
+    memset(sendHdrs_.data(), 0, sendHdrs_.size() * sizeof(mmsghdr));
+    for(size_t i = 0; i < batchSize_; ++i)
+    {
+        recvIov_[i].iov_base = &recvArena_[i * maxDatagramSize_];
+        recvIov_[i].iov_len = maxDatagramSize_;
+        recvHdrs_[i].msg_hdr.msg_iov = &recvIov_[i];
+        recvHdrs_[i].msg_hdr.msg_iovlen = 1;
+        recvHdrs_[i].msg_hdr.msg_name = &recvAddrs_[i];
+
+        sendIov_[i].iov_base = &sendArena_[i * maxDatagramSize_];
+        sendHdrs_[i].msg_hdr.msg_iov = &sendIov_[i];
+        sendHdrs_[i].msg_hdr.msg_iovlen = 1;
+        sendHdrs_[i].msg_hdr.msg_name = &sendAddrs_[i];
+    }
+
+    channel_.setReadCallback(
+        std::bind(&UdpChannel::handleRead, this, std::placeholders::_1)
+    );
+}
+
+UdpChannel::~UdpChannel()
+{
+}
+
+bool UdpChannel::enableGro()
+{
+    if(maxDatagramSize_ < kMaxGroSize)
+    {
+        LOG_ERROR("UdpChannel fd %d GRO needs maxDatagramSize >= %lu", socket_.fd(), static_cast<unsigned long>(kMaxGroSize));
+        return false;
+    }
+    int on = 1;
+    if(::setsockopt(socket_.fd(), SOL_UDP, UDP_GRO, &on, static_cast<socklen_t>(sizeof(on))) < 0)
+    {
+        LOG_ERROR("UdpChannel fd %d UDP_GRO error %d", socket_.fd(), errno);
+        return false;
+    }
+
+    /// 拆分后的消息数量最多为槽位数乘以最大分段数，在这里一次分配，收包时不再分配
+    recvControl_.assign(batchSize_ * kGroControlSize, 0);
+    messages_.resize(batchSize_ * kMaxSegments);
+    for(size_t i = 0; i < batchSize_; ++i)
+    {
+        recvHdrs_[i].msg_hdr.msg_control = &recvControl_[i * kGroControlSize];
+    }
+    groEnabled_ = true;
+    return true;
+}
+
+void UdpChannel::start()
+{
+    channel_.tie(shared_from_this());
+    channel_.enableReading();
+}
+
+void UdpChannel::stop()
+{
+    flush();
+    channel_.disableAll();
+    channel_.remove();
+}
+
+void UdpChannel::handleRead(Timestamp receiveTime)
+{
+    UdpChannelPtr guardThis(shared_from_this());
+    for(int round = 0; round < kMaxReadRounds; ++round)
+    {
+        for(size_t i = 0; i < batchSize_; ++i)
+        {
+            recvHdrs_[i].msg_hdr.msg_namelen = static_cast<socklen_t>(sizeof(sockaddr_storage));
+            recvHdrs_[i].msg_hdr.msg_flags = 0;
+            recvHdrs_[i].msg_hdr.msg_controllen = groEnabled_? kGroControlSize: 0;
+        }
+
+        int n = ::recvmmsg(socket_.fd(), recvHdrs_.data(), static_cast<unsigned int>(batchSize_), MSG_DONTWAIT, nullptr);
+        ++recvSyscalls_;
+        if(n < 0)
+        {
+            if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                LOG_ERROR("UdpChannel::handleRead fd %d recvmmsg error %d", socket_.fd(), errno);
+            }
+            break;
+        }
+
+        /// GRO合并的数据按分段大小拆回多个数据报，最后一段可以更短
+        size_t count = 0;
+        for(int i = 0; i < n; ++i)
+        {
+            const char* data = static_cast<const char*>(recvIov_[i].iov_base);
+            const size_t len = recvHdrs_[i].msg_len;
+            size_t segment = groEnabled_? groSegmentSize(&recvHdrs_[i].msg_hdr): 0;
+            if(segment == 0 || segment > len)
+            {
+                segment = len;
+            }
+            size_t offset = 0;
+            do
+            {
+                UdpMessage& msg = messages_[count++];
+                msg.data = data + offset;
+                msg.len = std::min(segment, len - offset);
+                msg.peer = (const sockaddr*)&recvAddrs_[i];
+                msg.peerLen = recvHdrs_[i].msg_hdr.msg_namelen;
+                msg.truncated = (recvHdrs_[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+                offset += segment;
+            } while(offset < len && count < messages_.size());
+        }
+        receivedDatagrams_ += static_cast<uint64_t>(count);
+
+        if(count > 0 && batchCallback_)
+        {
+            batchCallback_(guardThis, messages_.data(), count, receiveTime);
+        }
+        if(static_cast<size_t>(n) < batchSize_)
+        {
+            break;
+        }
+    }
+}
+
+bool UdpChannel::send(const sockaddr* peer, socklen_t peerLen, const void* data, size_t len)
+{
+    if(len > maxDatagramSize_)
+    {
+        ++sendSyscalls_;
+        if(::sendto(socket_.fd(), data, len, MSG_DONTWAIT, peer, peerLen) < 0)
+        {
+            ++droppedDatagrams_;
+            return false;
+        }
+        ++sentDatagrams_;
+        return true;
+    }
+
+    if(sendCount_ == batchSize_)
+    {
+        flush();
+    }
+
+    const size_t i = sendCount_++;
+    ::memcpy(sendIov_[i].iov_base, data, len);
+    sendIov_[i].iov_len = len;
+    ::memcpy(&sendAddrs_[i], peer, peerLen);
+    sendHdrs_[i].msg_hdr.msg_namelen = peerLen;
+    scheduleFlush();
+    return true;
+}
+
+bool UdpChannel::sendSegmented(const sockaddr* peer, socklen_t peerLen, const void* data, size_t len, size_t segmentSize)
+{
+    /// 分段大小为0时无法推进，超过一个UDP数据报的最大长度时也无法发出
+    if(segmentSize == 0 || segmentSize > kMaxGsoBytes)
+    {
+        LOG_ERROR("UdpChannel fd %d invalid segment size %lu", fd(), static_cast<unsigned long>(segmentSize));
+        return false;
+    }
+    if(len <= segmentSize)
+    {
+        return send(peer, peerLen, data, len);
+    }
+
+    flush();
+    const size_t maxChunk = std::min(kMaxSegments, kMaxGsoBytes / segmentSize) * segmentSize;
+    const char* p = static_cast<const char*>(data);
+    bool ok = true;
+    while(len > 0)
+    {
+        const size_t chunk = std::min(len, maxChunk);
+        if(gsoSupported_ && chunk > segmentSize)
+        {
+            const GsoResult result = sendGso(peer, peerLen, p, chunk, segmentSize);
+            if(result == kGsoSent)
+            {
+                p += chunk;
+                len -= chunk;
+                continue;
+            }
+            if(result == kGsoDropped)
+            {
+                droppedDatagrams_ += (chunk + segmentSize - 1) / segmentSize;
+                ok = false;
+                p += chunk;
+                len -= chunk;
+                continue;
+            }
+        }
+
+        /// 内核不支持GSO，或这一次的分段参数被拒绝，逐个排入发送区
+        for(size_t offset = 0; offset < chunk; offset += segmentSize)
+        {
+            ok = send(peer, peerLen, p + offset, std::min(segmentSize, chunk - offset)) && ok;
+        }
+        p += chunk;
+        len -= chunk;
+    }
+    return ok;
+}
+
+UdpChannel::GsoResult UdpChannel::sendGso(const sockaddr* peer, socklen_t peerLen, const char* data, size_t len, size_t segmentSize)
+{
+    char control[CMSG_SPACE(sizeof(uint16_t))];
+    memset(control, 0, sizeof(control));
+    iovec iov;
+    iov.iov_base = const_cast<char*>(data);
+    iov.iov_len = len;
+
+    msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_name = const_cast<sockaddr*>(peer);
+    hdr.msg_namelen = peerLen;
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof(control);
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    const uint16_t gsoSize = static_cast<uint16_t>(segmentSize);
+    ::memcpy(CMSG_DATA(cmsg), &gsoSize, sizeof(gsoSize));
+
+    ssize_t n;
+    do
+    {
+        n = ::sendmsg(socket_.fd(), &hdr, MSG_DONTWAIT);
+        ++sendSyscalls_;
+    } while(n < 0 && errno == EINTR);
+
+    if(n >= 0)
+    {
+        sentDatagrams_ += (len + segmentSize - 1) / segmentSize;
+        return kGsoSent;
+    }
+    /// EINVAL：分段加头部超过路由MTU或分段数超过上限，只是这一次不能用GSO
+    if(errno == EINVAL)
+    {
+        return kGsoFallback;
+    }
+    /// EIO为网卡不支持校验和卸载，其余为内核不支持UDP_SEGMENT，之后都不再尝试
+    if(errno == EIO || errno == ENOPROTOOPT || errno == EOPNOTSUPP)
+    {
+        LOG_ERROR("UdpChannel fd %d UDP_SEGMENT unsupported (error %d), falling back to sendmmsg", socket_.fd(), errno);
+        gsoSupported_ = false;
+        return kGsoFallback;
+    }
+    if(errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS)
+    {
+        LOG_ERROR("UdpChannel fd %d GSO sendmsg error %d", socket_.fd(), errno);
+    }
+    return kGsoDropped;
+}
+
+void UdpChannel::scheduleFlush()
+{
+    if(!flushQueued_)
+    {
+        flushQueued_ = true;
+        loop_->runBeforePoll(
+            std::bind(&UdpChannel::flushScheduled, shared_from_this())
+        );
+    }
+}
+
+void UdpChannel::flushScheduled()
+{
+    flushQueued_ = false;
+    flush();
+}
+
+void UdpChannel::flush()
+{
+    size_t sent = 0;
+    while(sent < sendCount_)
+    {
+        int n = ::sendmmsg(socket_.fd(), &sendHdrs_[sent], static_cast<unsigned int>(sendCount_ - sent), MSG_DONTWAIT);
+        ++sendSyscalls_;
+        if(n > 0)
+        {
+            sent += static_cast<size_t>(n);
+            sentDatagrams_ += static_cast<uint64_t>(n);
+        }
+        else if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS))
+        {
+            droppedDatagrams_ += sendCount_ - sent;
+            break;
+        }
+        else
+        {
+            /// 错误属于第一个未发出的数据报(如ECONNREFUSED)，跳过它继续发送其余的
+            LOG_ERROR("UdpChannel::flush fd %d sendmmsg error %d", socket_.fd(), errno);
+            ++droppedDatagrams_;
+            ++sent;
+        }
+    }
+    sendCount_ = 0;
+}
+
+} // namespace muduo_study
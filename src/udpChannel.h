@@ -0,0 +1,185 @@
+#pragma once
+
+#include "nocopyable.h"
+#include "timestamp.h"
+#include "inetAddress.h"
+#include "socket.h"
+#include "channel.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+#include <sys/socket.h>
+
+
+namespace muduo_study
+{
+
+class EventLoop;
+class UdpChannel;
+using UdpChannelPtr = std::shared_ptr<UdpChannel>;
+
+/**
+ * @brief 一批数据报中的一个
+ * @note data和peer指向UdpChannel的接收区，只在批量回调期间有效
+ */
+struct UdpMessage
+{
+    const char* data;
+    size_t len;
+    const sockaddr* peer;
+    socklen_t peerLen;
+    /// 数据报长于maxDatagramSize，data只包含前maxDatagramSize字节
+    bool truncated;
+};
+
+/**
+ * @brief 注册在EventLoop上的数据报socket
+ * @details 可读时用recvmmsg一次读入一批数据报，接收区(数据、iovec、mmsghdr、地址)在构造时一次分配，之后收包不再分配内存；
+ * @details send把数据报拷贝进发送区，在本轮loop结束、下一次poll之前用一次sendmmsg统一发出，发送区满时立即发送。
+ * @details UDP没有流控，内核发送缓冲区满(EAGAIN/ENOBUFS)时丢弃数据报并计数，不注册写事件
+ * @note 除构造外只能在所属loop线程中使用
+ */
+class UdpChannel: nocopyable,
+    public std::enable_shared_from_this<UdpChannel>
+{
+public:
+    using BatchCallback = std::function<void(const UdpChannelPtr&, const UdpMessage* messages, size_t count, Timestamp)>;
+
+    /**
+     * @param[in] bindAddr 端口为0时由内核分配，通过localAddress获取
+     * @param[in] reusePort 是否设置SO_REUSEPORT，多个socket绑定同一地址时内核按四元组哈希分流
+     * @param[in] batchSize 每次recvmmsg/sendmmsg最多处理的数据报数量
+     * @param[in] maxDatagramSize 每个数据报在接收区/发送区中占用的槽位大小
+     */
+    UdpChannel(EventLoop* loop, const InetAddress& bindAddr, bool reusePort,
+               size_t batchSize = 64, size_t maxDatagramSize = 2048);
+    ~UdpChannel();
+
+    void setBatchCallback(const BatchCallback& cb) { batchCallback_ = cb; }
+
+    /**
+     * @brief 注册读事件/从poller中移除，只能在所属loop线程调用
+     */
+    void start();
+    void stop();
+
+    /**
+     * @brief 发送一个数据报，只能在所属loop线程调用
+     * @details 长度不超过maxDatagramSize时排入发送区，否则立即sendto
+     * @return false表示数据报被内核拒绝而丢弃
+     */
+    bool send(const sockaddr* peer, socklen_t peerLen, const void* data, size_t len);
+    bool send(const InetAddress& peer, const void* data, size_t len)
+    {
+        return send(peer.getSockAddr(), peer.length(), data, len);
+    }
+
+    /**
+     * @brief 以UDP_SEGMENT(GSO)发送len/segmentSize个等长的数据报(最后一个可以更短)，只能在所属loop线程调用
+     * @details 每次sendmsg最多携带64个分段、不超过64KB，由内核(或网卡)切分，代替逐个数据报经过协议栈；
+     * @details 先发出发送区中已排队的数据报以保证顺序。内核不支持GSO(构造时探测)，或某次分段参数被拒绝(如分段超过路由MTU)时，
+     * @details 退化为逐个排入发送区，由sendmmsg批量发出
+     * @return false表示有数据报被丢弃，或segmentSize为0、超过单个UDP数据报的最大长度(65507)而整体未发送
+     */
+    bool sendSegmented(const sockaddr* peer, socklen_t peerLen, const void* data, size_t len, size_t segmentSize);
+    bool sendSegmented(const InetAddress& peer, const void* data, size_t len, size_t segmentSize)
+    {
+        return sendSegmented(peer.getSockAddr(), peer.length(), data, len, segmentSize);
+    }
+
+    /**
+     * @brief 开启UDP_GRO，内核把同一流的多个数据报合并后一次交付，在用户态按分段大小拆回UdpMessage
+     * @note 合并后的数据最长64KB，要求maxDatagramSize不小于kMaxGroSize，否则返回false；需在start之前调用
+     */
+    bool enableGro();
+    bool groEnabled() const { return groEnabled_; }
+
+    /// GRO合并后的最大长度与每次合并/GSO的最大分段数
+    static const size_t kMaxGroSize = 65535;
+    static const size_t kMaxSegments = 64;
+
+    /**
+     * @brief 立即用sendmmsg发出发送区中的所有数据报
+     * @note 已安排的poll之前的flush仍会执行(发送区为空时什么也不做)，之后的send不会再安排新的任务
+     */
+    void flush();
+
+    EventLoop* getLoop() const { return loop_; }
+    int fd() const { return socket_.fd(); }
+    const InetAddress& localAddress() const { return localAddr_; }
+    Socket& socket() { return socket_; }
+
+    /**
+     * @brief 统计：收到/发出/丢弃的数据报数量，以及recvmmsg/sendmmsg的调用次数
+     */
+    uint64_t receivedDatagrams() const { return receivedDatagrams_; }
+    uint64_t sentDatagrams() const { return sentDatagrams_; }
+    uint64_t droppedDatagrams() const { return droppedDatagrams_; }
+    uint64_t recvSyscalls() const { return recvSyscalls_; }
+    uint64_t sendSyscalls() const { return sendSyscalls_; }
+
+private:
+    /// 一次可读事件中最多调用recvmmsg的次数，避免一个socket独占loop
+    static const int kMaxReadRounds = 4;
+
+    void handleRead(Timestamp receiveTime);
+
+    /**
+     * @brief 安排一次poll之前的flush；已安排时不再重复安排
+     * @note flushQueued_只由安排的任务清除，显式flush不清除，否则不运行loop而只显式flush的调用者每次send都会追加一个任务
+     */
+    void scheduleFlush();
+    void flushScheduled();
+
+    /**
+     * @brief sendGso的结果：已发出，被丢弃(发送缓冲区满等)，需要逐个发送(内核或网卡不支持，或这一次的分段参数被拒绝)
+     */
+    enum GsoResult
+    {
+        kGsoSent,
+        kGsoDropped,
+        kGsoFallback
+    };
+
+    /**
+     * @brief 一次sendmsg携带UDP_SEGMENT控制消息；内核不支持时清除gsoSupported_，EINVAL只对这一次退化
+     */
+    GsoResult sendGso(const sockaddr* peer, socklen_t peerLen, const char* data, size_t len, size_t segmentSize);
+
+    EventLoop* loop_;
+    Socket socket_;
+    Channel channel_;
+    InetAddress localAddr_;
+    const size_t batchSize_;
+    const size_t maxDatagramSize_;
+    BatchCallback batchCallback_;
+
+    /// 接收区，第i个数据报读入recvArena_[i*maxDatagramSize_]
+    std::vector<char> recvArena_;
+    std::vector<iovec> recvIov_;
+    std::vector<sockaddr_storage> recvAddrs_;
+    std::vector<mmsghdr> recvHdrs_;
+    std::vector<UdpMessage> messages_;
+    /// 开启GRO后每个槽位的控制消息缓冲区，用于取得UDP_GRO分段大小
+    std::vector<char> recvControl_;
+    bool groEnabled_;
+    bool gsoSupported_;
+
+    /// 发送区，sendCount_个数据报待发送
+    std::vector<char> sendArena_;
+    std::vector<iovec> sendIov_;
+    std::vector<sockaddr_storage> sendAddrs_;
+    std::vector<mmsghdr> sendHdrs_;
+    size_t sendCount_;
+    bool flushQueued_;
+
+    uint64_t receivedDatagrams_;
+    uint64_t sentDatagrams_;
+    uint64_t droppedDatagrams_;
+    uint64_t recvSyscalls_;
+    uint64_t sendSyscalls_;
+};
+
+} // namespace muduo_study
@@ -0,0 +1,84 @@
+#include "udpServer.h"
+#include "eventLoop.h"
+#include "eventLoopThreadPool.h"
+#include "logger.h"
+
+#include <errno.h>
+#include <algorithm>
+
+
+namespace muduo_study
+{
+
+UdpServer::UdpServer(EventLoop* loop, const InetAddress& listenAddr, const std::string& nameArg)
+    : loop_(loop),
+    name_(nameArg),
+    localAddr_(listenAddr),
+    threadPool_(new EventLoopThreadPool(loop, nameArg)),
+    batchSize_(64),
+    maxDatagramSize_(2048),
+    recvBuffer_(0),
+    gro_(false),
+    started_(0)
+{
+}
+
+UdpServer::~UdpServer()
+{
+    for(const UdpChannelPtr& channel: channels_)
+    {
+        channel->getLoop()->runInloop(
+            std::bind(&UdpChannel::stop, channel)
+        );
+    }
+}
+
+void UdpServer::setThreadNum(int numThreads)
+{
+    threadPool_->setThreadNum(numThreads);
+}
+
+void UdpServer::start()
+{
+    if(started_++ != 0)
+    {
+        return ;
+    }
+
+    threadPool_->start(threadInitCallback_);
+    std::vector<EventLoop*> loops = threadPool_->getAllLoops();
+    const bool reusePort = loops.size() > 1;
+    if(gro_)
+    {
+        maxDatagramSize_ = std::max(maxDatagramSize_, UdpChannel::kMaxGroSize);
+    }
+
+    /// 在mainloop中依次绑定，端口为0时后续的socket绑定第一个socket分到的端口
+    for(EventLoop* ioLoop: loops)
+    {
+        UdpChannelPtr channel = std::make_shared<UdpChannel>(ioLoop, localAddr_, reusePort, batchSize_, maxDatagramSize_);
+        if(recvBuffer_ > 0 && !channel->socket().setRecvBuffer(recvBuffer_))
+        {
+            LOG_ERROR("UdpServer %s fd %d SO_RCVBUF error %d", name_.c_str(), channel->fd(), errno);
+        }
+        if(gro_)
+        {
+            channel->enableGro();
+        }
+        channel->setBatchCallback(batchCallback_);
+        localAddr_ = channel->localAddress();
+        channels_.push_back(channel);
+    }
+
+    LOG_INFO("UdpServer %s listening on %s with %lu socket(s)", name_.c_str(), localAddr_.toIpPort().c_str(),
+             static_cast<unsigned long>(channels_.size()));
+
+    for(const UdpChannelPtr& channel: channels_)
+    {
+        channel->getLoop()->runInloop(
+            std::bind(&UdpChannel::start, channel)
+        );
+    }
+}
+
+} // namespace muduo_study
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "nocopyable.h"
+#include "udpChannel.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <atomic>
+
+
+namespace muduo_study
+{
+
+class EventLoop;
+class EventLoopThreadPool;
+
+/**
+ * @brief udpServer封装类
+ * @details 没有设置线程数量时，只在用户创建的loop上注册一个UdpChannel；
+ * @details 设置了线程数量时，每个ioloop各有一个UdpChannel，都以SO_REUSEPORT绑定同一地址，由内核按四元组把数据报分流到各个socket，
+ * @details 同一个对端的数据报总是由同一个loop处理，各loop之间没有共享状态
+ * @note BatchCallback在各个ioloop中并发执行
+ */
+class UdpServer: nocopyable
+{
+public:
+    using ThreadInitCallback = std::function<void(EventLoop*)>;
+
+    UdpServer(EventLoop* loop, const InetAddress& listenAddr, const std::string& nameArg);
+    ~UdpServer();
+
+    const std::string& name() const { return name_; }
+    EventLoop* getLoop() const { return loop_; }
+    std::shared_ptr<EventLoopThreadPool> threadPool() { return threadPool_; }
+
+    /**
+     * @brief 设置线程数量，即分片的socket数量，需在start之前设置
+     */
+    void setThreadNum(int numThreads);
+    void setThreadInitCallback(const ThreadInitCallback& cb) { threadInitCallback_ = cb; }
+
+    /**
+     * @brief 给与用户设置收到一批数据报时的回调，在start之前设置
+     */
+    void setBatchCallback(const UdpChannel::BatchCallback& cb) { batchCallback_ = cb; }
+
+    /**
+     * @brief 每次recvmmsg的数据报数量与每个数据报的槽位大小，需在start之前设置
+     */
+    void setBatchSize(size_t batchSize) { batchSize_ = batchSize; }
+    void setMaxDatagramSize(size_t size) { maxDatagramSize_ = size; }
+
+    /**
+     * @brief 开启UDP_GRO，需在start之前设置；maxDatagramSize会被提高到UdpChannel::kMaxGroSize
+     * @note 每个socket的接收区和发送区各为batchSize*64KB，开启GRO时宜减小batchSize
+     */
+    void setGro(bool on) { gro_ = on; }
+
+    /**
+     * @brief 每个socket的SO_RCVBUF，0表示使用内核默认值，需在start之前设置
+     */
+    void setRecvBuffer(int bytes) { recvBuffer_ = bytes; }
+
+    /**
+     * @brief 启动线程池，创建并绑定所有socket，然后在各自的loop中注册读事件
+     */
+    void start();
+
+    /**
+     * @brief 实际绑定的地址，端口为0时在start之后才能得到内核分配的端口
+     */
+    const InetAddress& localAddress() const { return localAddr_; }
+
+    /**
+     * @brief 所有分片的UdpChannel，start之后只读
+     */
+    const std::vector<UdpChannelPtr>& channels() const { return channels_; }
+
+private:
+    EventLoop* loop_;
+    const std::string name_;
+    InetAddress localAddr_;
+    std::shared_ptr<EventLoopThreadPool> threadPool_;
+    ThreadInitCallback threadInitCallback_;
+    UdpChannel::BatchCallback batchCallback_;
+    size_t batchSize_;
+    size_t maxDatagramSize_;
+    int recvBuffer_;
+    bool gro_;
+    std::atomic_int started_;
+    std::vector<UdpChannelPtr> channels_;
+};
+
+} // namespace muduo_study
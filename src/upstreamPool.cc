@@ -0,0 +1,330 @@
+#include "upstreamPool.h"
+#include "tcpClient.h"
+#include "tcpConnection.h"
+#include "eventLoop.h"
+#include "timerQueue.h"
+#include "logger.h"
+
+
+namespace muduo_study
+{
+
+const size_t UpstreamPool::kParseError;
+
+UpstreamPool::UpstreamPool(EventLoop* loop, const InetAddress& serverAddr, const std::string& nameArg,
+                           const ResponseParser& parser, size_t minConnections, size_t maxConnections)
+    : loop_(loop),
+    serverAddr_(serverAddr),
+    name_(nameArg),
+    parser_(parser),
+    minConnections_(minConnections),
+    maxConnections_(maxConnections < 1? 1: (maxConnections < minConnections? minConnections: maxConnections)),
+    requestTimeout_(0),
+    idleTimeout_(0),
+    healthInterval_(0),
+    maintenanceInterval_(1.0),
+    retryDelayInit_(0.5),
+    retryDelayMax_(30),
+    nextEntryId_(0),
+    maintenanceTimer_(0)
+{
+}
+
+UpstreamPool::~UpstreamPool()
+{
+    if(maintenanceTimer_ != 0)
+    {
+        loop_->cancel(maintenanceTimer_);
+    }
+
+    /// TcpClient析构后连接可能还会断开一次，先摘掉指向本对象的回调
+    for(auto& item: entries_)
+    {
+        const TcpConnectionPtr& conn = item.second->conn;
+        if(conn)
+        {
+            conn->setConnectionCallback([](const TcpConnectionPtr&){});
+            conn->setMessageCallback(defaultMessageCallback);
+        }
+    }
+}
+
+void UpstreamPool::start()
+{
+    while(entries_.size() < minConnections_)
+    {
+        addConnection();
+    }
+    if(maintenanceTimer_ == 0 && maintenanceInterval_ > 0)
+    {
+        maintenanceTimer_ = loop_->runEvery(maintenanceInterval_,
+            std::bind(&UpstreamPool::maintain, this)
+        );
+    }
+}
+
+void UpstreamPool::addConnection()
+{
+    const uint64_t entryId = ++nextEntryId_;
+    std::unique_ptr<Entry> entry(new Entry);
+    entry->client.reset(new TcpClient(loop_, serverAddr_, name_ + "#" + std::to_string(entryId)));
+    entry->lastActiveUs = TimerQueue::now();
+    entry->lastRequestUs = entry->lastActiveUs;
+    entry->closing = false;
+
+    TcpClient* client = entry->client.get();
+    client->enableRetry();
+    client->setRetryDelay(retryDelayInit_, retryDelayMax_);
+    client->setSocketOptions(socketOptions_);
+    client->setConnectionCallback(
+        std::bind(&UpstreamPool::onConnection, this, entryId, std::placeholders::_1)
+    );
+    client->setMessageCallback(
+        std::bind(&UpstreamPool::onMessage, this, entryId, std::placeholders::_1, std::placeholders::_2)
+    );
+
+    entries_[entryId] = std::move(entry);
+    client->connect();
+}
+
+void UpstreamPool::onConnection(uint64_t entryId, const TcpConnectionPtr& conn)
+{
+    auto it = entries_.find(entryId);
+    if(it == entries_.end())
+    {
+        return ;
+    }
+    Entry* entry = it->second.get();
+
+    if(conn->connected())
+    {
+        entry->conn = conn;
+        entry->lastActiveUs = TimerQueue::now();
+        entry->lastRequestUs = entry->lastActiveUs;
+        flushWaiting();
+        return ;
+    }
+
+    entry->conn.reset();
+    std::deque<PendingRequest> pending;
+    pending.swap(entry->pending);
+    if(entry->closing)
+    {
+        /// 当前正处于该TcpClient的连接回调中，延迟到本轮loop结束后再析构
+        std::shared_ptr<TcpClient> client(std::move(entry->client));
+        loop_->queueInloop([client]{});
+        entries_.erase(it);
+    }
+    failPending(pending);
+}
+
+void UpstreamPool::onMessage(uint64_t entryId, const TcpConnectionPtr& conn, Buff* buf)
+{
+    auto it = entries_.find(entryId);
+    if(it == entries_.end())
+    {
+        buf->retrieveAll();
+        return ;
+    }
+    Entry* entry = it->second.get();
+    entry->lastActiveUs = TimerQueue::now();
+
+    while(buf->readableBytes() > 0)
+    {
+        if(entry->pending.empty())
+        {
+            const unsigned long unexpected = static_cast<unsigned long>(buf->readableBytes());
+            LOG_ERROR("UpstreamPool %s unexpected %lu bytes from %s", name_.c_str(), unexpected, conn->name().c_str());
+            buf->retrieveAll();
+            conn->forceClose();
+            break;
+        }
+
+        const size_t len = parser_(buf->peek(), buf->readableBytes());
+        if(len == 0)
+        {
+            break;
+        }
+        if(len == kParseError || len > buf->readableBytes())
+        {
+            LOG_ERROR("UpstreamPool %s bad response from %s", name_.c_str(), conn->name().c_str());
+            buf->retrieveAll();
+            conn->forceClose();
+            break;
+        }
+
+        /// 回调中可能再次发起请求并排入同一个entry，先出队再回调
+        ResponseCallback cb(std::move(entry->pending.front().callback));
+        entry->pending.pop_front();
+        cb(true, buf->peek(), len);
+        buf->retrieve(len);
+    }
+}
+
+UpstreamPool::Entry* UpstreamPool::leastOutstanding(bool* connecting)
+{
+    Entry* best = nullptr;
+    *connecting = false;
+    for(auto& item: entries_)
+    {
+        Entry* entry = item.second.get();
+        if(entry->closing)
+        {
+            continue;
+        }
+        if(!entry->conn)
+        {
+            *connecting = true;
+            continue;
+        }
+        if(best == nullptr || entry->pending.size() < best->pending.size())
+        {
+            best = entry;
+            if(best->pending.empty())
+            {
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+void UpstreamPool::request(const PayloadPtr& payload, const ResponseCallback& cb)
+{
+    bool connecting = false;
+    Entry* best = leastOutstanding(&connecting);
+
+    /// 所有连接都在忙且没有正在建立的连接时扩容，新连接建立后分担之后的请求
+    if((best == nullptr || !best->pending.empty()) && !connecting && entries_.size() < maxConnections_)
+    {
+        addConnection();
+    }
+
+    if(best == nullptr)
+    {
+        waiting_.push_back(WaitingRequest{payload, cb, TimerQueue::now()});
+        return ;
+    }
+    dispatch(best, payload, cb);
+}
+
+void UpstreamPool::dispatch(Entry* entry, const PayloadPtr& payload, const ResponseCallback& cb, bool probe)
+{
+    const int64_t now = TimerQueue::now();
+    entry->pending.push_back(PendingRequest{cb, now});
+    entry->lastActiveUs = now;
+    if(!probe)
+    {
+        entry->lastRequestUs = now;
+    }
+    entry->conn->send(payload);
+}
+
+void UpstreamPool::flushWaiting()
+{
+    bool connecting = false;
+    while(!waiting_.empty())
+    {
+        Entry* best = leastOutstanding(&connecting);
+        if(best == nullptr)
+        {
+            break;
+        }
+        WaitingRequest req(std::move(waiting_.front()));
+        waiting_.pop_front();
+        dispatch(best, req.payload, req.callback);
+    }
+}
+
+void UpstreamPool::failPending(std::deque<PendingRequest>& pending)
+{
+    for(PendingRequest& req: pending)
+    {
+        req.callback(false, nullptr, 0);
+    }
+    pending.clear();
+}
+
+void UpstreamPool::retire(Entry* entry)
+{
+    LOG_INFO("UpstreamPool %s retire idle connection %s", name_.c_str(), entry->conn->name().c_str());
+    entry->closing = true;
+    entry->client->stop();
+    entry->conn->forceClose();
+}
+
+void UpstreamPool::maintain()
+{
+    const int64_t now = TimerQueue::now();
+    const int64_t timeoutUs = static_cast<int64_t>(requestTimeout_ * 1000 * 1000);
+    const int64_t idleUs = static_cast<int64_t>(idleTimeout_ * 1000 * 1000);
+    const int64_t healthUs = static_cast<int64_t>(healthInterval_ * 1000 * 1000);
+
+    std::deque<WaitingRequest> expired;
+    while(timeoutUs > 0 && !waiting_.empty() && now - waiting_.front().queuedUs >= timeoutUs)
+    {
+        expired.push_back(std::move(waiting_.front()));
+        waiting_.pop_front();
+    }
+
+    size_t live = 0;
+    for(auto& item: entries_)
+    {
+        live += item.second->closing? 0: 1;
+    }
+
+    /// forceClose在本轮loop之后才执行，断开回调不会在遍历中修改entries_
+    for(auto& item: entries_)
+    {
+        Entry* entry = item.second.get();
+        if(entry->closing || !entry->conn)
+        {
+            continue;
+        }
+        if(!entry->pending.empty())
+        {
+            if(timeoutUs > 0 && now - entry->pending.front().sentUs >= timeoutUs)
+            {
+                LOG_ERROR("UpstreamPool %s request timeout on %s", name_.c_str(), entry->conn->name().c_str());
+                entry->conn->forceClose();
+            }
+            continue;
+        }
+        if(idleUs > 0 && live > minConnections_ && now - entry->lastRequestUs >= idleUs)
+        {
+            retire(entry);
+            --live;
+        }
+        else if(probe_ && healthUs > 0 && now - entry->lastActiveUs >= healthUs)
+        {
+            dispatch(entry, probe_, [](bool, const char*, size_t){}, true);
+        }
+    }
+
+    for(WaitingRequest& req: expired)
+    {
+        req.callback(false, nullptr, 0);
+    }
+}
+
+size_t UpstreamPool::connectedCount() const
+{
+    size_t n = 0;
+    for(const auto& item: entries_)
+    {
+        n += (item.second->conn && !item.second->closing)? 1: 0;
+    }
+    return n;
+}
+
+size_t UpstreamPool::outstanding() const
+{
+    size_t n = 0;
+    for(const auto& item: entries_)
+    {
+        n += item.second->pending.size();
+    }
+    return n;
+}
+
+} // namespace muduo_study
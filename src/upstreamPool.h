@@ -0,0 +1,171 @@
+#pragma once
+
+#include "nocopyable.h"
+#include "callback.h"
+#include "inetAddress.h"
+#include "socketOptions.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <deque>
+#include <map>
+
+
+namespace muduo_study
+{
+
+class EventLoop;
+class TcpClient;
+
+/**
+ * @brief 单个EventLoop上到同一个上游的持久连接池
+ * @details 连接数保持在[minConnections, maxConnections]之间：start时建立min个连接，所有连接都有未完成请求时再新建，
+ * @details 超过idleTimeout没有请求的多余连接被关闭；断开的连接由TcpClient按退避重连。
+ * @details 请求总是发往未完成请求最少的连接，同一连接上的请求流水线发送，响应按发送顺序与请求一一对应。
+ * @note 池只属于构造时的loop，所有方法都必须在该loop线程中调用，内部没有锁；
+ * @note 多线程服务为每个ioloop各建一个池(例如在TcpServer的ThreadInitCallback中创建)，请求在连接所属的loop内完成，不跨线程
+ */
+class UpstreamPool: nocopyable
+{
+public:
+    /**
+     * @brief 从输入缓冲区头部切分出一个完整的响应
+     * @return 响应的字节数；0表示数据不完整，等待更多数据；kParseError表示协议错误，连接会被关闭
+     */
+    using ResponseParser = std::function<size_t(const char* data, size_t len)>;
+
+    /**
+     * @brief 响应回调
+     * @param ok 为false表示请求失败(连接断开或超时)，此时data为nullptr
+     * @note data指向连接的inputBuffer_内部，只在回调期间有效
+     */
+    using ResponseCallback = std::function<void(bool ok, const char* data, size_t len)>;
+
+    static const size_t kParseError = static_cast<size_t>(-1);
+
+    UpstreamPool(EventLoop* loop, const InetAddress& serverAddr, const std::string& nameArg,
+                 const ResponseParser& parser, size_t minConnections = 1, size_t maxConnections = 8);
+    ~UpstreamPool();
+
+    /**
+     * @brief 建立min个连接，并开始周期性的维护(超时、空闲回收、健康检查)
+     */
+    void start();
+
+    /**
+     * @brief 发送一个请求，响应或失败时执行cb
+     * @details 没有可用连接时请求排队，连接建立后按顺序发出
+     */
+    void request(const PayloadPtr& payload, const ResponseCallback& cb);
+    void request(std::string&& payload, const ResponseCallback& cb)
+    {
+        request(std::make_shared<const std::string>(std::move(payload)), cb);
+    }
+
+    /**
+     * @brief 请求超时，单位秒，0表示不超时。连接上最早的请求超时后该连接被强制关闭，其上所有请求失败
+     */
+    void setRequestTimeout(double seconds) { requestTimeout_ = seconds; }
+
+    /**
+     * @brief 多于minConnections的连接空闲超过该时间后被关闭，0表示不回收
+     */
+    void setIdleTimeout(double seconds) { idleTimeout_ = seconds; }
+
+    /**
+     * @brief 健康检查：连接空闲超过interval秒时发送probe，probe按普通请求处理，配合requestTimeout发现失效的连接
+     */
+    void setHealthCheck(const PayloadPtr& probe, double interval) { probe_ = probe; healthInterval_ = interval; }
+
+    /**
+     * @brief 维护定时器的周期，需在start之前设置，默认1秒
+     */
+    void setMaintenanceInterval(double seconds) { maintenanceInterval_ = seconds; }
+    void setRetryDelay(double initial, double max) { retryDelayInit_ = initial; retryDelayMax_ = max; }
+    void setSocketOptions(const SocketOptions& options) { socketOptions_ = options; }
+
+    /**
+     * @brief 统计：连接总数(含正在连接的)、已建立的连接数、未完成的请求数、等待连接的请求数
+     */
+    size_t size() const { return entries_.size(); }
+    size_t connectedCount() const;
+    size_t outstanding() const;
+    size_t waiting() const { return waiting_.size(); }
+
+private:
+    struct PendingRequest
+    {
+        ResponseCallback callback;
+        int64_t sentUs;
+    };
+
+    struct WaitingRequest
+    {
+        PayloadPtr payload;
+        ResponseCallback callback;
+        int64_t queuedUs;
+    };
+
+    /**
+     * @brief 池中的一个连接
+     * @details closing为true的连接已被回收，不再分配请求，断开后从池中删除
+     */
+    struct Entry
+    {
+        std::unique_ptr<TcpClient> client;
+        TcpConnectionPtr conn;
+        std::deque<PendingRequest> pending;
+        /// 最近一次收发的时间，用于健康检查；最近一次用户请求的时间，用于空闲回收
+        int64_t lastActiveUs;
+        int64_t lastRequestUs;
+        bool closing;
+    };
+    using EntryMap = std::map<uint64_t, std::unique_ptr<Entry>>;
+
+    void addConnection();
+    void onConnection(uint64_t entryId, const TcpConnectionPtr& conn);
+    void onMessage(uint64_t entryId, const TcpConnectionPtr& conn, Buff* buf);
+
+    /**
+     * @brief 选出未完成请求最少的已连接Entry，没有时返回nullptr
+     * @param[out] connecting 是否有正在建立的连接
+     */
+    Entry* leastOutstanding(bool* connecting);
+
+    /**
+     * @param probe 健康检查请求不计入lastRequestUs，不会阻止空闲回收
+     */
+    void dispatch(Entry* entry, const PayloadPtr& payload, const ResponseCallback& cb, bool probe = false);
+    void flushWaiting();
+
+    /**
+     * @brief 连接断开时使entry上所有未完成的请求失败
+     */
+    static void failPending(std::deque<PendingRequest>& pending);
+    void maintain();
+    void retire(Entry* entry);
+
+    EventLoop* loop_;
+    const InetAddress serverAddr_;
+    const std::string name_;
+    ResponseParser parser_;
+    const size_t minConnections_;
+    const size_t maxConnections_;
+
+    double requestTimeout_;
+    double idleTimeout_;
+    PayloadPtr probe_;
+    double healthInterval_;
+    double maintenanceInterval_;
+    double retryDelayInit_;
+    double retryDelayMax_;
+    SocketOptions socketOptions_;
+
+    uint64_t nextEntryId_;
+    EntryMap entries_;
+    std::deque<WaitingRequest> waiting_;
+    TimerId maintenanceTimer_;
+};
+
+} // namespace muduo_study